@@ -0,0 +1,83 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+// Built as an executable of its own: it replaces the global operator new,
+// which must not affect the other tests.
+
+#include <transitionparser/feature.h>
+#include <transitionparser/state.h>
+#include <transitionparser/transition.h>
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "synthetic.h"
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+namespace {
+
+// Only the allocations of a thread inside a Counting scope are counted.
+thread_local bool counting = false;
+thread_local size_t num_allocations = 0;
+
+class Counting {
+ public:
+  Counting() {
+    counting = true;
+  }
+
+  ~Counting() {
+    counting = false;
+  }
+};
+
+}  // namespace
+
+// The array and nothrow forms call this one. None of the replacements are
+// inlined, so that the compiler does not pair malloc and free with new and
+// delete and report a mismatch.
+__attribute__((noinline)) void* operator new(size_t size) {
+  if (counting) ++num_allocations;
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+TEST(AllocationTest, ExtractDoesNotAllocate) {
+  const std::vector<Sentence> sentences = synthetic::createSentences(50);
+
+  unsigned buffer[Feature::kNFeatures];
+  // the first call interns the padding token
+  Feature::extract(State(sentences[0]), buffer);
+  size_t num_tokens = 0;
+  size_t allocations = 0;
+  for (const auto& sentence : sentences) {
+    State state(sentence);
+    while (!Transition::isTerminal(state)) {
+      {
+        Counting scope;
+        Feature::extract(state, buffer);
+      }
+      allocations += num_allocations;
+      num_allocations = 0;
+      Transition::apply(Transition::getOracle(state), &state);
+    }
+    num_tokens += sentence.length - 1;
+  }
+  ASSERT_GT(num_tokens, 0u);
+  EXPECT_EQ(0.0, static_cast<double>(allocations) / num_tokens)
+      << "allocations per token";
+}
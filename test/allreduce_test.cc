@@ -0,0 +1,117 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/allreduce.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <csignal>
+#include <chrono>  // NOLINT(build/c++11)
+#include <stdexcept>
+#include <vector>
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+namespace {
+
+// The value of element i of rank k in round r.
+float value(unsigned k, size_t i, unsigned r) {
+  return static_cast<float>((k + 1) * (i % 7) + r);
+}
+
+}  // namespace
+
+TEST(AllReduceTest, SumAndUnite) {
+  const size_t size = 1000;
+  for (unsigned n : {1, 2, 3, 4}) {
+    SharedAllReduce allreduce(n, size);
+    auto results = utility::process::fork_join_here<int>(n, [&](unsigned k) {
+      int errors = 0;
+      for (unsigned r = 0; r < 5; ++r) {
+        // two spans of different sizes on every rank
+        std::vector<float> a(size / 4), b(size - size / 4 - r);
+        for (size_t i = 0; i < a.size(); ++i) a[i] = value(k, i, r);
+        for (size_t i = 0; i < b.size(); ++i) b[i] = value(k, i + a.size(), r);
+        allreduce.sum(k, {{a.data(), a.size()}, {b.data(), b.size()}});
+        for (size_t i = 0; i < a.size() + b.size(); ++i) {
+          float expected = 0.0f;
+          for (unsigned other = 0; other < n; ++other) {
+            expected += value(other, i, r);
+          }
+          errors += (i < a.size() ? a[i] : b[i - a.size()]) != expected;
+        }
+        std::vector<unsigned> ids = {k, 100 + r, 2 * k + 1};
+        std::vector<unsigned> all = allreduce.unite(k, ids);
+        std::vector<unsigned> expected;
+        for (unsigned other = 0; other < n; ++other) {
+          expected.push_back(other);
+          expected.push_back(2 * other + 1);
+        }
+        expected.push_back(100 + r);
+        std::sort(expected.begin(), expected.end());
+        expected.erase(std::unique(expected.begin(), expected.end()),
+                       expected.end());
+        errors += all != expected;
+      }
+      return errors;
+    });
+    for (unsigned k = 0; k < n; ++k) {
+      EXPECT_EQ(0, results[k]) << "rank " << k << " of " << n;
+    }
+  }
+}
+
+TEST(AllReduceTest, Abort) {
+  SharedAllReduce allreduce(3, 16);
+  EXPECT_THROW(utility::process::fork_join_here<int>(3, [&](unsigned k) {
+                 if (k == 2) {
+                   allreduce.abort();
+                   throw std::runtime_error("expected failure");
+                 }
+                 float x = 1.0f;
+                 allreduce.sum(k, {{&x, 1}});
+                 return 0;
+               }),
+               std::runtime_error);
+}
+
+// A rank killed by a signal never calls abort(); the others must still
+// give up, and the dead child must be reaped.
+TEST(AllReduceTest, DeadRank) {
+  SharedAllReduce allreduce(3, 16);
+  EXPECT_THROW(utility::process::fork_join_here<int>(3, [&](unsigned k) {
+                 if (k == 2) {
+                   std::raise(SIGKILL);
+                 }
+                 float x = 1.0f;
+                 allreduce.sum(k, {{&x, 1}});
+                 return 0;
+               }),
+               std::runtime_error);
+}
+
+// Reports the time of one reduction of gradients the size of the parser's
+// dense parameters (about 3.7M values) over n processes.
+TEST(AllReduceTest, DISABLED_Throughput) {
+  using clock = std::chrono::steady_clock;
+  const size_t size = 52 * 64 * 1024 + 1024 + 1024 * 256 + 256 + 256 * 80;
+  const int rounds = 20;
+  for (unsigned n : {1, 2, 4}) {
+    SharedAllReduce allreduce(n, size);
+    auto results = utility::process::fork_join_here<double>(
+        n, [&](unsigned k) {
+          std::vector<float> gradients(size, 1.0f);
+          allreduce.sum(k, {{gradients.data(), size}});
+          auto start = clock::now();
+          for (int r = 0; r < rounds; ++r) {
+            allreduce.sum(k, {{gradients.data(), size}});
+          }
+          return std::chrono::duration<double, std::milli>(
+              clock::now() - start).count() / rounds;
+        });
+    std::cout << "processes=" << n << ": " << results[0]
+              << " ms per reduction of " << size << " values" << std::endl;
+  }
+}
@@ -0,0 +1,161 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/classifier.h>
+#include <transitionparser/feature.h>
+#include <transitionparser/native_classifier.h>
+#include <dynet/dynet.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "synthetic.h"
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+namespace {
+
+const unsigned kWordVocabSize = 500;
+const unsigned kPosVocabSize = 40;
+const unsigned kLabelVocabSize = 30;
+const unsigned kOutputSize = 2 * (kLabelVocabSize - 2) + 1;
+
+}  // namespace
+
+class ClassifierTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    classifier_ = std::make_unique<MlpClassifier>(
+        model_,
+        kWordVocabSize, 64, Feature::kNWordFeatures,
+        kPosVocabSize, 32, Feature::kNPosFeatures,
+        kLabelVocabSize, 32, Feature::kNLabelFeatures,
+        256, 64, kOutputSize);
+  }
+
+  virtual void TearDown() {}
+
+  std::vector<FeatureVector> sampleFeatures(size_t size) {
+    return synthetic::sampleFeatures(size, kWordVocabSize, kPosVocabSize,
+                                     kLabelVocabSize, &engine_);
+  }
+
+  dynet::ParameterCollection model_;
+  std::unique_ptr<MlpClassifier> classifier_;
+  std::mt19937 engine_;
+};
+
+TEST_F(ClassifierTest, NativeParity) {
+  NativeMlpClassifier native(*classifier_);
+  auto features = sampleFeatures(64);
+
+  dynet::ComputationGraph cg;
+  classifier_->prepare(&cg);
+  auto expected = classifier_->compute_batch(features);
+  auto actual = native.compute_batch(features);
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(expected[i].size(), actual[i].size());
+    for (size_t j = 0; j < expected[i].size(); ++j) {
+      EXPECT_NEAR(expected[i][j], actual[i][j], 1e-4);
+    }
+  }
+
+  auto single = native.compute(features[0]);
+  for (size_t j = 0; j < single.size(); ++j) {
+    EXPECT_NEAR(expected[0][j], single[j], 1e-4);
+  }
+}
+
+TEST_F(ClassifierTest, PrecomputedParity) {
+  NativeMlpClassifier native(*classifier_);
+  NativeMlpClassifier precomputed(*classifier_);
+  std::vector<unsigned> words;
+  for (unsigned word = 0; word < kWordVocabSize; word += 2) {
+    words.push_back(word);
+  }
+  precomputed.precompute(words);
+
+  auto features = sampleFeatures(64);
+  auto expected = native.compute_batch(features);
+  auto actual = precomputed.compute_batch(features);
+  for (size_t i = 0; i < expected.size(); ++i) {
+    for (size_t j = 0; j < expected[i].size(); ++j) {
+      EXPECT_NEAR(expected[i][j], actual[i][j], 1e-4);
+    }
+  }
+}
+
+TEST_F(ClassifierTest, DISABLED_PrecomputedLatency) {
+  using clock = std::chrono::steady_clock;
+  NativeMlpClassifier native(*classifier_);
+  NativeMlpClassifier precomputed(*classifier_);
+  std::vector<unsigned> words(kWordVocabSize);
+  std::iota(words.begin(), words.end(), 0);
+  precomputed.precompute(words);
+
+  auto features = sampleFeatures(1024);
+  for (auto* classifier : {&native, &precomputed}) {
+    auto start = clock::now();
+    for (const auto& feature : features) {
+      classifier->compute(feature);
+    }
+    double elapsed = std::chrono::duration<double, std::micro>(
+        clock::now() - start).count();
+    std::cout << (classifier == &native ? "full multiply" : "precomputed")
+              << ": " << elapsed / features.size() << " us/step"
+              << std::endl;
+  }
+}
+
+TEST_F(ClassifierTest, QuantizedCloseToFloat) {
+  NativeMlpClassifier native(*classifier_);
+  QuantizedMlpClassifier quantized(*classifier_);
+  auto features = sampleFeatures(64);
+  auto expected = native.compute_batch(features);
+  auto actual = quantized.compute_batch(features);
+  for (size_t i = 0; i < expected.size(); ++i) {
+    float max_abs = 0.0f;
+    for (float score : expected[i]) {
+      max_abs = std::max(max_abs, std::abs(score));
+    }
+    for (size_t j = 0; j < expected[i].size(); ++j) {
+      EXPECT_NEAR(expected[i][j], actual[i][j], 0.05 * max_abs + 1e-3);
+    }
+  }
+}
+
+TEST_F(ClassifierTest, DISABLED_NativeThroughput) {
+  using clock = std::chrono::steady_clock;
+  NativeMlpClassifier native(*classifier_);
+  QuantizedMlpClassifier quantized(*classifier_);
+  dynet::ComputationGraph cg;
+  classifier_->prepare(&cg);
+
+  for (size_t batch_size : {1, 32, 256}) {
+    auto features = sampleFeatures(batch_size);
+    const int num_steps = 2048 / batch_size + 16;
+    for (auto* classifier : std::vector<Classifier*>{classifier_.get(),
+                                                     &native, &quantized}) {
+      auto start = clock::now();
+      for (int step = 0; step < num_steps; ++step) {
+        classifier->compute_batch(features);
+      }
+      double elapsed = std::chrono::duration<double>(
+          clock::now() - start).count();
+      std::cout << (classifier == &native ? "native   " :
+                    classifier == &quantized ? "quantized" : "dynet    ")
+                << " batch=" << batch_size << ": "
+                << num_steps * batch_size / elapsed << " samples/sec"
+                << std::endl;
+    }
+  }
+}
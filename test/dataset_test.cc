@@ -0,0 +1,179 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/corpus.h>
+#include <transitionparser/dataset.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "synthetic.h"
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+class DatasetTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    filepath_ = ::testing::TempDir() + "dataset_test.bin";
+  }
+
+  virtual void TearDown() {
+    std::remove(filepath_.c_str());
+  }
+
+  std::string filepath_;
+};
+
+// Checks that every example of `actual` equals the one of `expected`,
+// gathering them in shuffled batches of the given size.
+void expectSameExamples(const ExampleSource& expected,
+                        const ExampleSource& actual, size_t batch_size) {
+  ASSERT_EQ(expected.size(), actual.size());
+  std::vector<size_t> indices(expected.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  std::shuffle(indices.begin(), indices.end(), std::mt19937());
+  FeatureMatrix expected_features, actual_features;
+  std::vector<unsigned> expected_actions, actual_actions;
+  for (size_t offset = 0; offset < indices.size(); offset += batch_size) {
+    size_t n = std::min(batch_size, indices.size() - offset);
+    expected.gather(indices.data() + offset, n, &expected_features,
+                    &expected_actions);
+    actual.gather(indices.data() + offset, n, &actual_features,
+                  &actual_actions);
+    EXPECT_EQ(expected_actions, actual_actions);
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(expected_features.row(i), actual_features.row(i));
+    }
+  }
+}
+
+TEST_F(DatasetTest, MappedMatchesInMemory) {
+  Corpus corpus = synthetic::createCorpus(200);
+  InMemoryExamples expected(corpus);
+  MappedExamples::write(filepath_, corpus);
+  MappedExamples actual(filepath_);
+  expectSameExamples(expected, actual, 64);
+}
+
+TEST_F(DatasetTest, CacheFollowsSource) {
+  const std::string source = ::testing::TempDir() + "dataset_test.conll";
+  std::ofstream(source) << "1\tw\t_\tT\tT\t_\t0\troot\t_\t_\n\n";
+  Corpus corpus = synthetic::createCorpus(10);
+  MappedExamples::write(filepath_, corpus, source);
+  EXPECT_TRUE(MappedExamples::isUpToDate(filepath_, source));
+  EXPECT_FALSE(MappedExamples::isUpToDate(filepath_, source + ".missing"));
+  std::ofstream(source, std::ios::app) << "\n";
+  EXPECT_FALSE(MappedExamples::isUpToDate(filepath_, source));
+  MappedExamples::write(filepath_, corpus);
+  EXPECT_FALSE(MappedExamples::isUpToDate(filepath_, source));
+  std::remove(source.c_str());
+}
+
+TEST_F(DatasetTest, ReplayMatchesInMemory) {
+  Corpus corpus = synthetic::createCorpus(200);
+  InMemoryExamples expected(corpus);
+  ReplayExamples actual(corpus);
+  expectSameExamples(expected, actual, 64);
+  expectSameExamples(expected, actual, 1024);
+}
+
+// Labels past the first 127 make more than 256 actions, which are stored in
+// two bytes.
+TEST_F(DatasetTest, ReplayWideActions) {
+  std::mt19937 engine;
+  std::uniform_int_distribution<unsigned> length(1, 40);
+  Corpus corpus;
+  for (int i = 0; i < 50; ++i) {
+    Sentence sentence =
+        synthetic::createRandomSentence(i + 1, length(engine), &engine);
+    for (unsigned j = 1; j < sentence.length; ++j) {
+      Token::Ids ids = sentence.tokens[j].ids();
+      ids.label += 200;
+      corpus.push_back(ids);
+    }
+    corpus.close();
+  }
+  InMemoryExamples expected(corpus);
+  ReplayExamples actual(corpus);
+  expectSameExamples(expected, actual, 64);
+}
+
+// Labels past the first 32767 make more than 65536 actions, which the
+// cache stores in four bytes.
+TEST_F(DatasetTest, MappedWideActions) {
+  std::mt19937 engine;
+  std::uniform_int_distribution<unsigned> length(1, 40);
+  Corpus corpus;
+  for (int i = 0; i < 50; ++i) {
+    Sentence sentence =
+        synthetic::createRandomSentence(i + 1, length(engine), &engine);
+    for (unsigned j = 1; j < sentence.length; ++j) {
+      Token::Ids ids = sentence.tokens[j].ids();
+      ids.label += 40000;
+      corpus.push_back(ids);
+    }
+    corpus.close();
+  }
+  InMemoryExamples expected(corpus);
+  MappedExamples::write(filepath_, corpus);
+  MappedExamples actual(filepath_);
+  expectSameExamples(expected, actual, 64);
+}
+
+// Compares the time to have the examples of a corpus ready for training:
+// replaying the oracle over the corpus against opening a cache file.
+TEST_F(DatasetTest, DISABLED_StartupTime) {
+  using clock = std::chrono::steady_clock;
+  Corpus corpus = synthetic::createCorpus(50000);
+  MappedExamples::write(filepath_, corpus);
+
+  auto start = clock::now();
+  InMemoryExamples in_memory(corpus);
+  double replayed = std::chrono::duration<double, std::milli>(
+      clock::now() - start).count();
+  start = clock::now();
+  MappedExamples mapped(filepath_);
+  double opened = std::chrono::duration<double, std::milli>(
+      clock::now() - start).count();
+  EXPECT_EQ(in_memory.size(), mapped.size());
+  std::cout << in_memory.size() << " examples: oracle " << replayed
+            << " ms, cache " << opened << " ms" << std::endl;
+}
+
+// Compares one epoch of gathers from materialized and replayed examples.
+TEST_F(DatasetTest, DISABLED_ReplayThroughput) {
+  using clock = std::chrono::steady_clock;
+  Corpus corpus = synthetic::createCorpus(50000);
+  InMemoryExamples in_memory(corpus);
+  ReplayExamples replay(corpus);
+  std::vector<size_t> indices(in_memory.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  std::shuffle(indices.begin(), indices.end(), std::mt19937());
+  FeatureMatrix features;
+  std::vector<unsigned> actions;
+  for (size_t batch_size : {32, 1024}) {
+    for (const ExampleSource* examples :
+         std::vector<const ExampleSource*>{&in_memory, &replay}) {
+      auto start = clock::now();
+      for (size_t offset = 0; offset < indices.size(); offset += batch_size) {
+        examples->gather(indices.data() + offset,
+                         std::min(batch_size, indices.size() - offset),
+                         &features, &actions);
+      }
+      double elapsed = std::chrono::duration<double>(
+          clock::now() - start).count();
+      std::cout << (examples == &in_memory ? "materialized" : "replay      ")
+                << " batch=" << batch_size << ": "
+                << indices.size() / elapsed << " examples/sec" << std::endl;
+    }
+  }
+}
@@ -0,0 +1,193 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/feature.h>
+#include <transitionparser/state.h>
+#include <transitionparser/transition.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <random>
+#include <vector>
+
+#include "synthetic.h"
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+class FeatureTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    sentences_ = synthetic::createSentences(50);
+  }
+
+  virtual void TearDown() {}
+
+  std::vector<Sentence> sentences_;
+};
+
+TEST_F(FeatureTest, StridedMatchesVector) {
+  const size_t batch_size = sentences_.size();
+  std::vector<unsigned> rows(batch_size * Feature::kNFeatures);
+  std::vector<unsigned> columns(batch_size * Feature::kNFeatures);
+  std::vector<State> states(sentences_.begin(), sentences_.end());
+  for (int step = 0; step < 10; ++step) {
+    for (size_t i = 0; i < batch_size; ++i) {
+      Feature::extract(states[i], &rows[i * Feature::kNFeatures]);
+      Feature::extract(states[i], &columns[i], batch_size);
+    }
+    for (size_t i = 0; i < batch_size; ++i) {
+      FeatureVector expected = Feature::extract(states[i]);
+      ASSERT_EQ(Feature::kNFeatures, expected.size());
+      for (unsigned j = 0; j < Feature::kNFeatures; ++j) {
+        EXPECT_EQ(expected[j], rows[i * Feature::kNFeatures + j]);
+        EXPECT_EQ(expected[j], columns[j * batch_size + i]);
+      }
+      if (!Transition::isTerminal(states[i])) {
+        Transition::apply(Transition::getOracle(states[i]), &states[i]);
+      }
+    }
+  }
+}
+
+TEST_F(FeatureTest, MatrixMatchesRows) {
+  std::vector<FeatureVector> rows;
+  for (const auto& sentence : sentences_) {
+    rows.push_back(Feature::extract(State(sentence)));
+  }
+  FeatureMatrix matrix(rows);
+  ASSERT_EQ(rows.size(), matrix.batchSize());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    EXPECT_EQ(rows[i], matrix.row(i));
+    for (unsigned j = 0; j < Feature::kNFeatures; ++j) {
+      EXPECT_EQ(rows[i][j], matrix.slot(j)[i]);
+    }
+  }
+}
+
+// Compares the per-step cost of building the classifier input as a slot-major
+// matrix with the former path, which extracted one vector per state and then
+// transposed them into one vector per slot.
+TEST_F(FeatureTest, DISABLED_BatchOverhead) {
+  using clock = std::chrono::steady_clock;
+  std::mt19937 engine(1);
+  std::uniform_int_distribution<unsigned> length(5, 60);
+  std::vector<Sentence> sentences;
+  for (int i = 0; i < 1024; ++i) {
+    sentences.push_back(
+        synthetic::createRandomSentence(i + 1, length(engine), &engine));
+  }
+  std::vector<State> states(sentences.begin(), sentences.end());
+  for (auto& state : states) {
+    for (int step = 0; step < 5 && !Transition::isTerminal(state); ++step) {
+      Transition::apply(Transition::getOracle(state), &state);
+    }
+  }
+
+  for (size_t batch_size : {1, 32, 256, 1024}) {
+    const int num_steps = 65536 / batch_size;
+    unsigned checksum = 0;
+
+    auto start = clock::now();
+    for (int step = 0; step < num_steps; ++step) {
+      std::vector<FeatureVector> rows;
+      for (size_t i = 0; i < batch_size; ++i) {
+        rows.push_back(Feature::extract(states[i]));
+      }
+      std::vector<FeatureVector> slots;
+      for (unsigned j = 0; j < Feature::kNFeatures; ++j) {
+        FeatureVector slot(batch_size);
+        for (size_t i = 0; i < batch_size; ++i) {
+          slot[i] = rows[i][j];
+        }
+        slots.push_back(std::move(slot));
+      }
+      checksum += slots.back()[0];
+    }
+    double transposed = std::chrono::duration<double, std::micro>(
+        clock::now() - start).count() / num_steps;
+
+    FeatureMatrix matrix;
+    start = clock::now();
+    for (int step = 0; step < num_steps; ++step) {
+      matrix.resize(batch_size);
+      for (size_t i = 0; i < batch_size; ++i) {
+        matrix.set(i, states[i]);
+      }
+      checksum += matrix.slot(Feature::kNFeatures - 1)[0];
+    }
+    double direct = std::chrono::duration<double, std::micro>(
+        clock::now() - start).count() / num_steps;
+
+    std::cout << "batch=" << batch_size << ": transposed " << transposed
+              << " us/step, slot-major " << direct << " us/step"
+              << " (checksum " << checksum << ")" << std::endl;
+  }
+}
+
+// Checks the incremental children against a scan of the attached tokens,
+// i.e. the tokens that left the buffer and were popped from the stack.
+TEST_F(FeatureTest, ChildrenMatchScan) {
+  std::mt19937 engine(2);
+  for (int n = 0; n < 20; ++n) {
+    Sentence sentence = synthetic::createRandomSentence(n + 1, 80, &engine);
+    State state(sentence);
+    while (true) {
+      const std::vector<int>& stack = state.stack();
+      for (int head = 0; head < state.numTokens(); ++head) {
+        std::vector<int> left;
+        std::vector<int> right;
+        for (int i = 1; i < state.buffer(); ++i) {
+          if (state.head(i) != head ||
+              std::find(stack.begin(), stack.end(), i) != stack.end()) {
+            continue;
+          }
+          (i < head ? left : right).push_back(i);
+        }
+        std::reverse(right.begin(), right.end());
+        for (int nth = 1; nth <= 2; ++nth) {
+          size_t k = nth - 1;
+          EXPECT_EQ(k < left.size() ? left[k] : -1,
+                    state.leftmost(head, nth));
+          EXPECT_EQ(k < right.size() ? right[k] : -1,
+                    state.rightmost(head, nth));
+        }
+      }
+      if (Transition::isTerminal(state)) break;
+      Transition::apply(Transition::getOracle(state), &state);
+    }
+  }
+}
+
+// The cost of Feature::extract per token should not grow with the length
+// of the sentence.
+TEST_F(FeatureTest, DISABLED_ExtractScaling) {
+  using clock = std::chrono::steady_clock;
+  std::mt19937 engine(3);
+  unsigned buffer[Feature::kNFeatures];
+  for (unsigned length : {10, 30, 100, 300, 1000}) {
+    std::vector<Sentence> sentences;
+    for (unsigned num_tokens = 0; num_tokens < 100000; num_tokens += length) {
+      sentences.push_back(synthetic::createRandomSentence(
+          sentences.size() + 1, length, &engine));
+    }
+    double elapsed = 0.0;
+    size_t num_steps = 0;
+    for (const auto& sentence : sentences) {
+      State state(sentence);
+      while (!Transition::isTerminal(state)) {
+        auto start = clock::now();
+        Feature::extract(state, buffer);
+        elapsed += std::chrono::duration<double, std::nano>(
+            clock::now() - start).count();
+        ++num_steps;
+        Transition::apply(Transition::getOracle(state), &state);
+      }
+    }
+    std::cout << "length=" << length << ": "
+              << elapsed / (sentences.size() * length) << " ns/token, "
+              << elapsed / num_steps << " ns/step" << std::endl;
+  }
+}
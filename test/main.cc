@@ -3,9 +3,12 @@
 // Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
 //
 
+#include <dynet/dynet.h>
+
 #include "gtest/gtest.h"
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
+  dynet::initialize(argc, argv);
   return RUN_ALL_TESTS();
 }
@@ -0,0 +1,123 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/classifier.h>
+#include <transitionparser/feature.h>
+#include <transitionparser/model_bundle.h>
+#include <transitionparser/native_classifier.h>
+#include <transitionparser/token.h>
+#include <dynet/dynet.h>
+#include <dynet/io.h>
+#include <gtest/gtest.h>
+
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "synthetic.h"
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+class ModelBundleTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    filepath_ = ::testing::TempDir() + "model_bundle_test.model";
+    synthetic::internVocabulary();
+  }
+
+  virtual void TearDown() {
+    std::remove(filepath_.c_str());
+    std::remove((filepath_ + ".txt").c_str());
+  }
+
+  // Draws features over `word_vocab_size` words and the tags and labels of
+  // the dictionaries.
+  static FeatureMatrix sampleFeatures(size_t size, unsigned word_vocab_size) {
+    std::mt19937 engine;
+    return FeatureMatrix(synthetic::sampleFeatures(
+        size, word_vocab_size, Token::getDict(Token::POSTAG).size(),
+        Token::getDict(Token::DEPREL).size(), &engine));
+  }
+
+  static std::vector<std::string> words(const Token::Dict& dict) {
+    std::vector<std::string> words;
+    for (size_t i = 0; i < dict.size(); ++i) {
+      words.push_back(dict.lookup(static_cast<int>(i)));
+    }
+    return words;
+  }
+
+  std::string filepath_;
+};
+
+TEST_F(ModelBundleTest, RoundTrip) {
+  const std::vector<std::string> forms = words(Token::getDict(Token::FORM));
+
+  dynet::ParameterCollection model;
+  auto classifier = synthetic::createMlp(model, 500);
+  NativeMlpClassifier expected(*classifier);
+  expected.save(filepath_);
+
+  auto bundle = std::make_shared<const ModelBundle>(filepath_);
+  bundle->loadDictionaries();
+  EXPECT_EQ(forms, words(Token::getDict(Token::FORM)));
+  NativeMlpClassifier actual(bundle);
+
+  FeatureMatrix features = sampleFeatures(64, 500);
+  std::vector<float> expected_scores, actual_scores;
+  expected.compute_batch(features, &expected_scores);
+  actual.compute_batch(features, &actual_scores);
+  EXPECT_EQ(expected_scores, actual_scores);
+
+  QuantizedMlpClassifier expected_int8(*classifier);
+  QuantizedMlpClassifier actual_int8(bundle);
+  expected_int8.compute_batch(features, &expected_scores);
+  actual_int8.compute_batch(features, &actual_scores);
+  EXPECT_EQ(expected_scores, actual_scores);
+}
+
+// Compares the time from a saved 100k-word model to the first scores:
+// the former DyNet text format, which also needs the classifier rebuilt and
+// copied, against mapping a bundle.
+TEST_F(ModelBundleTest, DISABLED_ColdStart) {
+  using clock = std::chrono::steady_clock;
+  const unsigned word_vocab_size = 100000;
+  FeatureMatrix features = sampleFeatures(1, word_vocab_size);
+  std::vector<float> scores;
+  {
+    dynet::ParameterCollection model;
+    auto classifier = synthetic::createMlp(model, word_vocab_size);
+    dynet::TextFileSaver saver(filepath_ + ".txt");
+    saver.save(model);
+    NativeMlpClassifier(*classifier).save(filepath_);
+  }
+
+  auto start = clock::now();
+  {
+    dynet::ParameterCollection model;
+    auto classifier = synthetic::createMlp(model, word_vocab_size);
+    dynet::TextFileLoader loader(filepath_ + ".txt");
+    loader.populate(model);
+    NativeMlpClassifier native(*classifier);
+    native.compute_batch(features, &scores);
+  }
+  double text = std::chrono::duration<double, std::milli>(
+      clock::now() - start).count();
+
+  start = clock::now();
+  {
+    auto bundle = std::make_shared<const ModelBundle>(filepath_);
+    bundle->loadDictionaries();
+    NativeMlpClassifier native(bundle);
+    native.compute_batch(features, &scores);
+  }
+  double mapped = std::chrono::duration<double, std::milli>(
+      clock::now() - start).count();
+  std::cout << "text: " << text << " ms, bundle: " << mapped << " ms"
+            << std::endl;
+}
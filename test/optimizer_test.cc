@@ -0,0 +1,144 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/optimizer.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+namespace {
+
+const unsigned kNumRows = 200;
+const unsigned kDim = 8;
+
+// Draws the rows looked up in a step and a gradient that is zero elsewhere.
+std::vector<unsigned> sampleStep(std::mt19937* engine,
+                                 std::vector<float>* grads) {
+  std::uniform_int_distribution<unsigned> row(0, kNumRows - 1);
+  std::normal_distribution<float> value;
+  std::vector<unsigned> rows;
+  for (int i = 0; i < 20; ++i) {
+    rows.push_back(row(*engine));
+  }
+  std::sort(rows.begin(), rows.end());
+  rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+  std::fill(grads->begin(), grads->end(), 0.0f);
+  for (unsigned r : rows) {
+    for (unsigned i = 0; i < kDim; ++i) {
+      (*grads)[r * kDim + i] = value(*engine);
+    }
+  }
+  return rows;
+}
+
+}  // namespace
+
+TEST(SparseOptimizerTest, LazyMatchesDense) {
+  std::vector<unsigned> all_rows(kNumRows);
+  std::iota(all_rows.begin(), all_rows.end(), 0);
+  for (const std::string name : {"sgd", "adagrad"}) {
+    auto lazy = SparseOptimizer::create(name);
+    auto dense = SparseOptimizer::create(name);
+    lazy->addTable(kNumRows, kDim);
+    dense->addTable(kNumRows, kDim);
+    std::vector<float> lazy_values(kNumRows * kDim, 0.5f);
+    std::vector<float> dense_values(lazy_values);
+    std::vector<float> grads(kNumRows * kDim);
+    std::mt19937 engine;
+    for (int step = 0; step < 50; ++step) {
+      std::vector<unsigned> rows = sampleStep(&engine, &grads);
+      lazy->step();
+      lazy->update(0, lazy_values.data(), grads.data(), rows);
+      dense->step();
+      dense->update(0, dense_values.data(), grads.data(), all_rows);
+    }
+    EXPECT_EQ(dense_values, lazy_values) << name;
+  }
+}
+
+// Compares lazy Adam with a reference that decays the moments of every row
+// at every step, but moves a row only in the steps that look it up.
+TEST(SparseOptimizerTest, AdamDefersDecay) {
+  const float lr = 0.001f, beta1 = 0.9f, beta2 = 0.999f, eps = 1e-8f;
+  SparseAdam lazy(lr, beta1, beta2, eps);
+  lazy.addTable(kNumRows, kDim);
+  std::vector<float> values(kNumRows * kDim, 0.5f);
+  std::vector<float> expected(values);
+  std::vector<float> m(values.size(), 0.0f), v(values.size(), 0.0f);
+  std::vector<float> grads(values.size());
+  std::mt19937 engine;
+  for (int t = 1; t <= 100; ++t) {
+    std::vector<unsigned> rows = sampleStep(&engine, &grads);
+    lazy.step();
+    lazy.update(0, values.data(), grads.data(), rows);
+    for (size_t i = 0; i < values.size(); ++i) {
+      m[i] = beta1 * m[i] + (1 - beta1) * grads[i];
+      v[i] = beta2 * v[i] + (1 - beta2) * grads[i] * grads[i];
+    }
+    for (unsigned r : rows) {
+      for (unsigned i = r * kDim; i < (r + 1) * kDim; ++i) {
+        expected[i] -= lr * (m[i] / (1 - std::pow(beta1, t)))
+            / (std::sqrt(v[i] / (1 - std::pow(beta2, t))) + eps);
+      }
+    }
+  }
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_NEAR(expected[i], values[i], 1e-5) << i;
+  }
+}
+
+// Reports the time of one update of a 64-dimensional embedding table for
+// a batch of 32 examples with 20 word features, updating the rows it looks
+// up against updating every row.
+TEST(SparseOptimizerTest, DISABLED_UpdateScaling) {
+  using clock = std::chrono::steady_clock;
+  const unsigned dim = 64;
+  std::mt19937 engine;
+  for (unsigned num_rows : {10000, 100000, 400000}) {
+    std::vector<float> values(static_cast<size_t>(num_rows) * dim, 0.5f);
+    std::vector<float> grads(values.size(), 0.01f);
+    std::uniform_int_distribution<unsigned> row(0, num_rows - 1);
+    std::vector<unsigned> rows;
+    for (int i = 0; i < 32 * 20; ++i) {
+      rows.push_back(row(engine));
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    std::vector<unsigned> all_rows(num_rows);
+    std::iota(all_rows.begin(), all_rows.end(), 0);
+
+    for (const std::string name : {"sgd", "adagrad", "adam"}) {
+      double elapsed[2];
+      for (int dense = 0; dense < 2; ++dense) {
+        auto optimizer = SparseOptimizer::create(name);
+        optimizer->addTable(num_rows, dim);
+        const int num_steps = dense ? 5 : 200;
+        // the first step allocates the state
+        optimizer->step();
+        optimizer->update(0, values.data(), grads.data(),
+                          dense ? all_rows : rows);
+        auto start = clock::now();
+        for (int step = 0; step < num_steps; ++step) {
+          optimizer->step();
+          optimizer->update(0, values.data(), grads.data(),
+                            dense ? all_rows : rows);
+        }
+        elapsed[dense] = std::chrono::duration<double, std::micro>(
+            clock::now() - start).count() / num_steps;
+      }
+      std::cout << "rows=" << num_rows << " " << name << ": lazy "
+                << elapsed[0] << " us/step, dense " << elapsed[1]
+                << " us/step" << std::endl;
+    }
+  }
+}
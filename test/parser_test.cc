@@ -0,0 +1,320 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/classifier.h>
+#include <transitionparser/native_classifier.h>
+#include <transitionparser/parser.h>
+#include <dynet/dynet.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT(build/c++11)
+#include <ctime>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "synthetic.h"
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+namespace {
+
+// Counts the states scored by each compute_batch call of a classifier.
+class CountingClassifier : public Classifier {
+ public:
+  explicit CountingClassifier(std::shared_ptr<Classifier> classifier) :
+      classifier_(classifier), num_calls_(0), num_scored_(0) {}
+
+  std::vector<float> compute(const FeatureVector& feature) override {
+    return classifier_->compute(feature);
+  }
+
+  std::vector<std::vector<float>> compute_batch(
+      const std::vector<FeatureVector>& features) override {
+    return classifier_->compute_batch(features);
+  }
+
+  void compute_batch(const FeatureMatrix& features,
+                     std::vector<float>* scores) override {
+    ++num_calls_;
+    num_scored_ += features.batchSize();
+    classifier_->compute_batch(features, scores);
+  }
+
+  bool isThreadSafe() const override {
+    return classifier_->isThreadSafe();
+  }
+
+  size_t numCalls() const {
+    return num_calls_;
+  }
+
+  size_t numScored() const {
+    return num_scored_;
+  }
+
+  double meanBatchSize() const {
+    return static_cast<double>(num_scored_) / num_calls_;
+  }
+
+ private:
+  std::shared_ptr<Classifier> classifier_;
+  std::atomic<size_t> num_calls_;
+  std::atomic<size_t> num_scored_;
+};
+
+}  // namespace
+
+class ParserTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    // the classifier covers the ids of any synthetic sentence
+    synthetic::internVocabulary();
+    Token::createPad();
+    classifier_ = synthetic::createClassifier(model_);
+    sentences_ = synthetic::createSentences(50);
+  }
+
+  virtual void TearDown() {}
+
+  // Returns sentences of mixed lengths, from single words to 120 words, for
+  // the benchmarks.
+  static std::vector<Sentence> createMixed() {
+    std::mt19937 engine;
+    std::uniform_int_distribution<unsigned> length(1, 120);
+    std::vector<Sentence> sentences;
+    for (int i = 0; i < 2000; ++i) {
+      sentences.push_back(
+          synthetic::createRandomSentence(i + 1, length(engine), &engine));
+    }
+    return sentences;
+  }
+
+  dynet::ParameterCollection model_;
+  std::shared_ptr<NativeMlpClassifier> classifier_;
+  std::vector<Sentence> sentences_;
+};
+
+TEST_F(ParserTest, BeamOfOneIsGreedy) {
+  GreedyParser greedy(classifier_);
+  BeamParser beam(classifier_, 1);
+  auto expected = greedy.parse_batch(sentences_, 8);
+  auto actual = beam.parse_batch(sentences_, 8);
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i]->heads(), actual[i]->heads());
+    EXPECT_EQ(expected[i]->labels(), actual[i]->labels());
+  }
+}
+
+TEST_F(ParserTest, ThreadedMatchesSerial) {
+  GreedyParser parser(classifier_);
+  auto expected = parser.parse_batch(sentences_, 4);
+  auto actual = parser.parse_batch(sentences_, 4, 4);
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i]->heads(), actual[i]->heads());
+    EXPECT_EQ(expected[i]->labels(), actual[i]->labels());
+  }
+}
+
+TEST_F(ParserTest, ContinuousMatchesFixed) {
+  GreedyParser fixed(classifier_);
+  GreedyParser continuous(classifier_, 1, true);
+  for (unsigned num_threads : {1, 4}) {
+    auto expected = fixed.parse_batch(sentences_, 8);
+    auto actual = continuous.parse_batch(sentences_, 8, num_threads);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected[i]->heads(), actual[i]->heads());
+      EXPECT_EQ(expected[i]->labels(), actual[i]->labels());
+    }
+  }
+}
+
+// Compares the fixed batches with refilling the finished slots on sentences
+// of mixed lengths.
+TEST_F(ParserTest, DISABLED_ContinuousOccupancy) {
+  using clock = std::chrono::steady_clock;
+  const std::vector<Sentence> sentences = createMixed();
+  for (bool continuous : {false, true}) {
+    auto classifier = std::make_shared<CountingClassifier>(classifier_);
+    GreedyParser parser(classifier, 1, continuous);
+    auto start = clock::now();
+    parser.parse_batch(sentences, 64);
+    double elapsed = std::chrono::duration<double>(
+        clock::now() - start).count();
+    std::cout << (continuous ? "continuous" : "fixed") << ": "
+              << classifier->meanBatchSize() / 64 << " occupancy, "
+              << sentences.size() / elapsed << " sentences/sec" << std::endl;
+  }
+}
+
+TEST_F(ParserTest, PipelinedMatchesSerial) {
+  GreedyParser serial(classifier_);
+  GreedyParser pipelined(classifier_, 1, false, true);
+  for (size_t batch_size : {1, 3, 8}) {
+    auto expected = serial.parse_batch(sentences_, batch_size);
+    auto actual = pipelined.parse_batch(sentences_, batch_size);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      EXPECT_TRUE(Transition::isTerminal(*actual[i]));
+      EXPECT_EQ(expected[i]->heads(), actual[i]->heads());
+      EXPECT_EQ(expected[i]->labels(), actual[i]->labels());
+    }
+  }
+}
+
+// Compares the time per classifier call and the CPU time per wall time of
+// the serial and the pipelined loops; the pipeline can only pay off with a
+// core free for its helper thread.
+TEST_F(ParserTest, DISABLED_PipelineStepTime) {
+  using clock = std::chrono::steady_clock;
+  const std::vector<Sentence> sentences = createMixed();
+  for (bool pipelined : {false, true}) {
+    auto classifier = std::make_shared<CountingClassifier>(classifier_);
+    GreedyParser parser(classifier, 1, false, pipelined);
+    std::clock_t cpu_start = std::clock();
+    auto start = clock::now();
+    parser.parse_batch(sentences, 64);
+    double elapsed = std::chrono::duration<double>(
+        clock::now() - start).count();
+    double cpu = static_cast<double>(std::clock() - cpu_start) /
+        CLOCKS_PER_SEC;
+    std::cout << (pipelined ? "pipelined" : "serial") << ": "
+              << elapsed / classifier->numCalls() * 1e6 << " us/call, "
+              << classifier->meanBatchSize() << " states/call, "
+              << cpu / elapsed << " cpu utilization, "
+              << sentences.size() / elapsed << " sentences/sec" << std::endl;
+  }
+}
+
+// Every sentence starts with a forced SHIFT, and so does every state that
+// has reduced its stack to the root, none of which need the classifier.
+TEST_F(ParserTest, ForcedActionsSkipClassifier) {
+  const std::vector<Sentence>& sentences = sentences_;
+  GreedyParser serial(classifier_);
+  for (bool continuous : {false, true}) {
+    auto classifier = std::make_shared<CountingClassifier>(classifier_);
+    GreedyParser parser(classifier, 1, continuous);
+    auto states = parser.parse_batch(sentences, 8);
+    size_t num_steps = 0;
+    for (const auto& state : states) {
+      EXPECT_TRUE(Transition::isTerminal(*state));
+      num_steps += state->step();
+      auto expected = serial.parse(sentences[state->sentence().id - 1]);
+      EXPECT_EQ(expected->heads(), state->heads());
+      EXPECT_EQ(expected->labels(), state->labels());
+    }
+    EXPECT_LE(classifier->numScored() + sentences.size(), num_steps);
+  }
+}
+
+// Reports the share of the steps that the forced actions take without the
+// classifier.
+TEST_F(ParserTest, DISABLED_ForcedActionSavings) {
+  const std::vector<Sentence> sentences = createMixed();
+  for (bool continuous : {false, true}) {
+    auto classifier = std::make_shared<CountingClassifier>(classifier_);
+    GreedyParser parser(classifier, 1, continuous);
+    size_t num_steps = 0;
+    for (const auto& state : parser.parse_batch(sentences, 8)) {
+      num_steps += state->step();
+    }
+    std::cout << (continuous ? "continuous" : "fixed") << ": "
+              << 1.0 - static_cast<double>(classifier->numScored()) / num_steps
+              << " of the classifier rows saved" << std::endl;
+  }
+}
+
+TEST_F(ParserTest, RejectsContinuousPipelined) {
+  EXPECT_THROW(GreedyParser(classifier_, 1, true, true), std::runtime_error);
+}
+
+TEST_F(ParserTest, StreamKeepsInputOrder) {
+  GreedyParser parser(classifier_);
+  std::vector<std::unique_ptr<State>> expected;
+  for (const auto& sentence : sentences_) {
+    expected.push_back(parser.parse(sentence));
+  }
+  for (size_t window_size : {1, 7, 64}) {
+    size_t index = 0;
+    parser.parse_stream(
+        sentences_.begin(), sentences_.end(), window_size, 8,
+        [&](const State& state) {
+          ASSERT_LT(index, expected.size());
+          EXPECT_EQ(sentences_[index].id, state.sentence().id);
+          EXPECT_EQ(expected[index]->heads(), state.heads());
+          EXPECT_EQ(expected[index]->labels(), state.labels());
+          ++index;
+        });
+    EXPECT_EQ(sentences_.size(), index);
+  }
+}
+
+// Reads the sentences on demand, copied in turn from the fixture's, and
+// checks that no more than a window of them is alive at any time.
+TEST_F(ParserTest, StreamIsBounded) {
+  const size_t num_sentences = 500;
+  const size_t window_size = 20;
+  GreedyParser parser(classifier_, 1, true);
+  size_t num_read = 0;
+  size_t num_written = 0;
+  size_t max_alive = 0;
+  parser.parse_stream(
+      [&](std::vector<Sentence>* window) {
+        if (num_read == num_sentences) return false;
+        window->push_back(sentences_[num_read++ % sentences_.size()]);
+        max_alive = std::max(max_alive, num_read - num_written);
+        return true;
+      },
+      window_size, 8,
+      [&](const State& state) {
+        EXPECT_EQ(sentences_[num_written++ % sentences_.size()].id,
+                  state.sentence().id);
+        EXPECT_TRUE(Transition::isTerminal(state));
+      });
+  EXPECT_EQ(num_sentences, num_written);
+  EXPECT_EQ(window_size, max_alive);
+}
+
+TEST_F(ParserTest, DISABLED_ThreadScaling) {
+  using clock = std::chrono::steady_clock;
+  const std::vector<Sentence> sentences = createMixed();
+  GreedyParser parser(classifier_);
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned num_threads = 1; num_threads <= max_threads;
+       num_threads *= 2) {
+    auto start = clock::now();
+    parser.parse_batch(sentences, 32, num_threads);
+    double elapsed = std::chrono::duration<double>(
+        clock::now() - start).count();
+    std::cout << "threads=" << num_threads << ": "
+              << sentences.size() / elapsed << " sentences/sec" << std::endl;
+  }
+}
+
+TEST_F(ParserTest, BeamReachesTerminal) {
+  for (unsigned beam_width : {4, 8}) {
+    BeamParser beam(classifier_, beam_width);
+    for (auto& state : beam.parse_batch(sentences_, 16)) {
+      EXPECT_TRUE(Transition::isTerminal(*state));
+      EXPECT_EQ(2 * (state->numTokens() - 1), state->step());
+    }
+    auto state = beam.parse(sentences_[0]);
+    EXPECT_TRUE(Transition::isTerminal(*state));
+  }
+}
+
+TEST_F(ParserTest, BeamBatchesEvenly) {
+  BeamParser beam(classifier_, 2);
+  // 50 sentences in full batches of 10, and none at all
+  EXPECT_EQ(sentences_.size(), beam.parse_batch(sentences_, 10).size());
+  EXPECT_TRUE(beam.parse_batch(std::vector<Sentence>(), 10).empty());
+}
@@ -0,0 +1,107 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/corpus.h>
+#include <transitionparser/dataset.h>
+#include <transitionparser/prefetcher.h>
+#include <transitionparser/tools.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "synthetic.h"
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+TEST(PrefetcherTest, MatchesGather) {
+  Corpus corpus = synthetic::createCorpus(200);
+  InMemoryExamples examples(corpus);
+  tools::BatchIndices batches(examples.size(), 32);
+  FeatureMatrix features;
+  std::vector<unsigned> actions;
+  for (unsigned num_workers : {0, 1, 3}) {
+    for (size_t capacity : {1, 2, 5}) {
+      BatchPrefetcher prefetcher(examples, num_workers, capacity);
+      for (int epoch = 0; epoch < 2; ++epoch) {
+        batches.shuffle();
+        prefetcher.start(batches);
+        for (size_t b = 0; b < batches.size(); ++b) {
+          const BatchPrefetcher::Batch& batch = prefetcher.next();
+          examples.gather(batches[b].indices, batches[b].size, &features,
+                          &actions);
+          ASSERT_EQ(actions, batch.actions);
+          for (size_t i = 0; i < actions.size(); ++i) {
+            ASSERT_EQ(features.row(i), batch.features.row(i));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(PrefetcherTest, Stride) {
+  Corpus corpus = synthetic::createCorpus(100);
+  InMemoryExamples examples(corpus);
+  tools::BatchIndices batches(examples.size(), 16);
+  FeatureMatrix features;
+  std::vector<unsigned> actions;
+  BatchPrefetcher prefetcher(examples, 2, 3);
+  const size_t step = 3;
+  size_t num_batches = 0;
+  for (size_t first = 0; first < step; ++first) {
+    prefetcher.start(batches, first, step);
+    for (size_t b = first; b < batches.size(); b += step) {
+      const BatchPrefetcher::Batch& batch = prefetcher.next();
+      examples.gather(batches[b].indices, batches[b].size, &features,
+                      &actions);
+      ASSERT_EQ(actions, batch.actions);
+      ++num_batches;
+    }
+  }
+  EXPECT_EQ(batches.size(), num_batches);
+}
+
+// Reports examples/sec of an epoch over replayed examples, whose gathers are
+// the most expensive, with a stand-in for the training step that costs
+// about as much per example. "busy" keeps the training thread on the CPU as
+// DyNet does on CPU; "idle" leaves it to the workers, as when the step runs
+// on other cores or a device.
+TEST(PrefetcherTest, DISABLED_Throughput) {
+  using clock = std::chrono::steady_clock;
+  Corpus corpus = synthetic::createCorpus(20000);
+  ReplayExamples examples(corpus);
+  const size_t batch_size = 256;
+  const auto step_cost = std::chrono::microseconds(batch_size);
+  tools::BatchIndices batches(examples.size(), batch_size);
+  std::cout << std::thread::hardware_concurrency() << " hardware threads"
+            << std::endl;
+  for (bool busy : {true, false}) {
+    for (unsigned num_workers : {0, 1, 2, 4}) {
+      BatchPrefetcher prefetcher(examples, num_workers,
+                                 std::max(2u, 2 * num_workers));
+      prefetcher.start(batches);
+      unsigned checksum = 0;
+      auto start = clock::now();
+      for (size_t b = 0; b < batches.size(); ++b) {
+        checksum += prefetcher.next().actions[0];
+        if (busy) {
+          const auto until = clock::now() + step_cost;
+          while (clock::now() < until) {}
+        } else {
+          std::this_thread::sleep_for(step_cost);
+        }
+      }
+      double elapsed = std::chrono::duration<double>(
+          clock::now() - start).count();
+      std::cout << (busy ? "busy" : "idle") << " step, workers="
+                << num_workers << ": " << examples.size() / elapsed
+                << " examples/sec (checksum " << checksum << ")"
+                << std::endl;
+    }
+  }
+}
@@ -0,0 +1,277 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/classifier.h>
+#include <transitionparser/native_classifier.h>
+#include <transitionparser/parser.h>
+#include <transitionparser/server.h>
+#include <transitionparser/tools.h>
+#include <dynet/dynet.h>
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "synthetic.h"
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+namespace {
+
+// Throws from compute_batch while `failing` is set.
+class FailingClassifier : public Classifier {
+ public:
+  explicit FailingClassifier(std::shared_ptr<Classifier> classifier) :
+      failing(true), classifier_(classifier) {}
+
+  std::vector<float> compute(const FeatureVector& feature) override {
+    return classifier_->compute(feature);
+  }
+
+  std::vector<std::vector<float>> compute_batch(
+      const std::vector<FeatureVector>& features) override {
+    return classifier_->compute_batch(features);
+  }
+
+  void compute_batch(const FeatureMatrix& features,
+                     std::vector<float>* scores) override {
+    if (failing) throw std::runtime_error("expected failure");
+    classifier_->compute_batch(features, scores);
+  }
+
+  std::atomic<bool> failing;
+
+ private:
+  std::shared_ptr<Classifier> classifier_;
+};
+
+}  // namespace
+
+class ServerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    socket_path_ = ::testing::TempDir() + "server_test.sock";
+    sentences_ = synthetic::createSentences(200);
+    for (const auto& sentence : sentences_) {
+      lines_.push_back(toLines(sentence));
+    }
+    classifier_ = synthetic::createClassifier(model_);
+  }
+
+  virtual void TearDown() {}
+
+  static std::vector<std::string> toLines(const Sentence& sentence) {
+    std::vector<std::string> lines;
+    for (unsigned i = 1; i < sentence.length; ++i) {
+      const Token& token = sentence.tokens[i];
+      lines.push_back(utility::string::format(
+          "{}\t{}\t_\t_\t{}\t_\t{}\t{}\t_\t_", token.id, token.form,
+          token.postag, token.head, token.deprel));
+    }
+    return lines;
+  }
+
+  static std::string join(const std::vector<std::string>& lines) {
+    std::string text;
+    for (const auto& line : lines) {
+      text += line + "\n";
+    }
+    return text;
+  }
+
+  std::string socket_path_;
+  dynet::ParameterCollection model_;
+  std::shared_ptr<NativeMlpClassifier> classifier_;
+  std::vector<Sentence> sentences_;
+  std::vector<std::vector<std::string>> lines_;
+};
+
+TEST_F(ServerTest, MatchesGreedyParser) {
+  GreedyParser parser(classifier_);
+  std::vector<std::string> expected;
+  for (size_t i = 0; i < sentences_.size(); ++i) {
+    expected.emplace_back();
+    tools::write_conll(*parser.parse(sentences_[i]), lines_[i].data(),
+                       &expected.back());
+    // the reply comes without its blank line
+    expected.back().pop_back();
+  }
+
+  ParseServer server(classifier_, socket_path_, 16,
+                     std::chrono::microseconds(200));
+  const unsigned num_clients = 4;
+  std::vector<std::vector<std::string>> replies(num_clients);
+  std::vector<std::thread> clients;
+  for (unsigned k = 0; k < num_clients; ++k) {
+    clients.emplace_back([&, k]() {
+      ParseClient client(socket_path_);
+      for (size_t i = k; i < sentences_.size(); i += num_clients) {
+        replies[k].push_back(client.parse(join(lines_[i])));
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  for (unsigned k = 0; k < num_clients; ++k) {
+    for (size_t j = 0; j < replies[k].size(); ++j) {
+      EXPECT_EQ(expected[k + j * num_clients], replies[k][j]);
+    }
+  }
+  EXPECT_GT(server.meanBatchSize(), 1.0);
+}
+
+// An overlong line or sentence is answered with an error in its turn, and
+// the connection goes on with the next sentence.
+TEST_F(ServerTest, RejectsOversizedInput) {
+  GreedyParser parser(classifier_);
+  std::string expected;
+  tools::write_conll(*parser.parse(sentences_[0]), lines_[0].data(),
+                     &expected);
+  expected.pop_back();
+
+  ParseServer server(classifier_, socket_path_, 16,
+                     std::chrono::microseconds(200));
+  ParseClient client(socket_path_);
+  std::string long_line = lines_[0][0];
+  long_line.resize(ParseServer::kMaxLineLength + 1, '_');
+  EXPECT_EQ(utility::string::format("# error: a line exceeds {} bytes.\n",
+                                    ParseServer::kMaxLineLength),
+            client.parse(long_line + "\n" + join(lines_[1])));
+  EXPECT_EQ(expected, client.parse(join(lines_[0])));
+  std::vector<std::string> many_lines;
+  while (many_lines.size() <= ParseServer::kMaxTokens) {
+    many_lines.insert(many_lines.end(), lines_[1].begin(), lines_[1].end());
+  }
+  EXPECT_EQ(utility::string::format("# error: a sentence exceeds {} tokens.\n",
+                                    ParseServer::kMaxTokens),
+            client.parse(join(many_lines)));
+  EXPECT_EQ(expected, client.parse(join(lines_[0])));
+}
+
+// A classifier error is answered with an error in the turn of each sentence
+// of the failed batch, and the server goes on parsing.
+TEST_F(ServerTest, AnswersClassifierErrors) {
+  size_t index = 0;
+  while (sentences_[index].length < 4) ++index;
+  GreedyParser parser(classifier_);
+  std::string expected;
+  tools::write_conll(*parser.parse(sentences_[index]), lines_[index].data(),
+                     &expected);
+  expected.pop_back();
+
+  auto classifier = std::make_shared<FailingClassifier>(classifier_);
+  ParseServer server(classifier, socket_path_, 16,
+                     std::chrono::microseconds(200));
+  ParseClient client(socket_path_);
+  EXPECT_EQ("# error: expected failure\n",
+            client.parse(join(lines_[index])));
+  classifier->failing = false;
+  EXPECT_EQ(expected, client.parse(join(lines_[index])));
+}
+
+// A client that sends without reading its replies is stalled once the
+// replies waiting for it reach the limit, and gets all of them once it reads.
+TEST_F(ServerTest, StallsClientThatDoesNotRead) {
+  ParseServer server(classifier_, socket_path_, 16,
+                     std::chrono::microseconds(200));
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_GE(fd, 0);
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, socket_path_.c_str(),
+               sizeof(address.sun_path) - 1);
+  ASSERT_EQ(0, ::connect(fd, reinterpret_cast<sockaddr*>(&address),
+                         sizeof(address)));
+
+  // far more than the socket buffers and the pending replies can hold
+  const size_t num_requests = 100000;
+  std::string requests;
+  for (size_t i = 0; i < num_requests; ++i) {
+    requests += join(lines_[i % lines_.size()]) + "\n";
+  }
+  ASSERT_EQ(0, ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK));
+  size_t offset = 0;
+  bool stalled = false;
+  while (offset < requests.size()) {
+    ssize_t sent = ::send(fd, requests.data() + offset,
+                          requests.size() - offset, MSG_NOSIGNAL);
+    if (sent > 0) {
+      offset += sent;
+      continue;
+    }
+    ASSERT_TRUE(errno == EAGAIN || errno == EWOULDBLOCK);
+    pollfd writable = {fd, POLLOUT, 0};
+    if (::poll(&writable, 1, 1000) == 0) {
+      stalled = true;
+      break;
+    }
+  }
+  EXPECT_TRUE(stalled);
+
+  size_t num_replies = 0;
+  std::thread reader([&]() {
+    pollfd readable = {fd, POLLIN, 0};
+    std::string buffer;
+    while (num_replies < num_requests && ::poll(&readable, 1, 10000) > 0) {
+      char chunk[4096];
+      ssize_t received = ::recv(fd, chunk, sizeof(chunk), 0);
+      if (received < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+      if (received <= 0) break;
+      buffer.append(chunk, received);
+      size_t end;
+      while ((end = buffer.find("\n\n")) != std::string::npos) {
+        buffer.erase(0, end + 2);
+        ++num_replies;
+      }
+    }
+  });
+  while (offset < requests.size()) {
+    ssize_t sent = ::send(fd, requests.data() + offset,
+                          requests.size() - offset, MSG_NOSIGNAL);
+    if (sent > 0) {
+      offset += sent;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      pollfd writable = {fd, POLLOUT, 0};
+      ::poll(&writable, 1, 1000);
+    } else {
+      break;
+    }
+  }
+  reader.join();
+  ::close(fd);
+  EXPECT_EQ(num_requests, num_replies);
+}
+
+// Compares parsing every request on its own with merging the requests of
+// concurrent clients into shared batches.
+TEST_F(ServerTest, DISABLED_Latency) {
+  std::vector<std::string> requests;
+  for (const auto& lines : lines_) {
+    requests.push_back(join(lines));
+  }
+  for (size_t max_batch_size : {1, 8, 64}) {
+    ParseServer server(classifier_, socket_path_, max_batch_size,
+                       std::chrono::microseconds(500));
+    LoadReport report = generate_load(socket_path_, requests, 16, 2000);
+    std::cout << "max batch " << max_batch_size << ": "
+              << report.num_requests / report.seconds << " sentences/sec, p50 "
+              << report.p50_ms << " ms, p99 " << report.p99_ms << " ms, "
+              << server.meanBatchSize() << " states per batch" << std::endl;
+  }
+}
@@ -0,0 +1,43 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/shared_parameters.h>
+#include <transitionparser/utility.h>
+#include <dynet/dynet.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+// The workers write to the weights and to the gradients; only the weights
+// reach the parent.
+TEST(SharedParametersTest, SharesWeightsNotGradients) {
+  dynet::ParameterCollection model;
+  dynet::Parameter W = model.add_parameters({4, 3});
+  dynet::LookupParameter E = model.add_lookup_parameters(10, {5});
+  const std::vector<float> initial = dynet::as_vector(W.get_storage().values);
+  SharedParameters shared(&model);
+  EXPECT_EQ(initial, dynet::as_vector(W.get_storage().values));
+
+  utility::process::fork_join<int>(2, [&](unsigned k) {
+    W.get_storage().values.v[k] += 1.0f;
+    E.get_storage().values[3].v[k] = 2.0f;
+    W.get_storage().g.v[k] = 5.0f;
+    E.get_storage().grads[3].v[k] = 5.0f;
+    return 0;
+  });
+
+  const dynet::ParameterStorage& w = W.get_storage();
+  const dynet::LookupParameterStorage& e = E.get_storage();
+  for (unsigned k = 0; k < 2; ++k) {
+    EXPECT_EQ(initial[k] + 1.0f, w.values.v[k]);
+    EXPECT_EQ(2.0f, e.values[3].v[k]);
+    EXPECT_EQ(2.0f, e.all_values.v[3 * 5 + k]);
+    EXPECT_EQ(0.0f, w.g.v[k]);
+    EXPECT_EQ(0.0f, e.grads[3].v[k]);
+  }
+  EXPECT_EQ(initial[2], w.values.v[2]);
+}
@@ -0,0 +1,158 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#ifndef TEST_SYNTHETIC_H_
+#define TEST_SYNTHETIC_H_
+
+#include <transitionparser/classifier.h>
+#include <transitionparser/corpus.h>
+#include <transitionparser/feature.h>
+#include <transitionparser/native_classifier.h>
+#include <transitionparser/sentence.h>
+#include <transitionparser/state.h>
+#include <transitionparser/token.h>
+#include <transitionparser/transition.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace synthetic {
+
+using transitionparser::Corpus;
+using transitionparser::Feature;
+using transitionparser::FeatureVector;
+using transitionparser::MlpClassifier;
+using transitionparser::NativeMlpClassifier;
+using transitionparser::Sentence;
+using transitionparser::State;
+using transitionparser::Token;
+using transitionparser::Transition;
+
+const int kNumWords = 1000;
+const int kNumTags = 20;
+const int kNumLabels = 10;
+
+// Adds every word, tag and label of the sentences below to the dictionaries,
+// so that a classifier sized from them covers any sentence built later.
+inline void internVocabulary() {
+  for (int w = 0; w < kNumWords; ++w) {
+    Token(std::vector<std::string>{
+        "1", "w" + std::to_string(w), "_", "_",
+        "T" + std::to_string(w % kNumTags), "_", "0",
+        "l" + std::to_string(w % kNumLabels), "_", "_"});
+  }
+  Token::createRoot();
+}
+
+// Builds a sentence from the heads of tokens 1..n (`heads[0]` is ignored).
+inline Sentence createSentence(int id, const std::vector<int>& heads,
+                               std::mt19937* engine) {
+  std::uniform_int_distribution<int> word(0, kNumWords - 1);
+  std::uniform_int_distribution<int> label(0, kNumLabels - 1);
+  std::vector<Token> tokens;
+  tokens.push_back(Token::createRoot());
+  for (unsigned i = 1; i < heads.size(); ++i) {
+    int w = word(*engine);
+    tokens.emplace_back(std::vector<std::string>{
+        std::to_string(i), "w" + std::to_string(w), "_", "_",
+        "T" + std::to_string(w % kNumTags), "_", std::to_string(heads[i]),
+        heads[i] == 0 ? "root" : "l" + std::to_string(label(*engine)),
+        "_", "_"});
+  }
+  return Sentence(id, tokens);
+}
+
+// Builds a sentence with a random projective tree, obtained by applying
+// random legal arc-standard transitions.
+inline Sentence createRandomSentence(int id, unsigned length,
+                                     std::mt19937* engine) {
+  std::vector<int> heads(length + 1, 0);
+  Sentence skeleton = createSentence(id, heads, engine);
+  State state(skeleton);
+  std::uniform_int_distribution<int> coin(0, 2);
+  while (!Transition::isTerminal(state)) {
+    int choice = coin(*engine);
+    if (choice == 0 && Transition::isAllowedShift(state)) {
+      Transition::apply(Transition::shiftAction(), &state);
+    } else if (choice == 1 && Transition::isAllowedLeft(state)) {
+      Transition::apply(Transition::leftAction(0), &state);
+    } else if (Transition::isAllowedRight(state)) {
+      Transition::apply(Transition::rightAction(0), &state);
+    } else {
+      Transition::apply(Transition::shiftAction(), &state);
+    }
+  }
+  return createSentence(id, state.heads(), engine);
+}
+
+// Builds random sentences of 1 to 40 words.
+inline std::vector<Sentence> createSentences(size_t num_sentences) {
+  std::mt19937 engine;
+  std::uniform_int_distribution<unsigned> length(1, 40);
+  std::vector<Sentence> sentences;
+  for (size_t i = 0; i < num_sentences; ++i) {
+    sentences.push_back(
+        createRandomSentence(i + 1, length(engine), &engine));
+  }
+  return sentences;
+}
+
+// Builds a corpus of the same sentences.
+inline Corpus createCorpus(size_t num_sentences) {
+  return Corpus(createSentences(num_sentences));
+}
+
+// Builds a small classifier sized from the dictionaries as they stand, so
+// the sentences it scores must have been built before. A nonzero
+// `word_vocab_size` overrides the number of words.
+inline std::unique_ptr<MlpClassifier> createMlp(
+    dynet::ParameterCollection& model,  // NOLINT(runtime/references)
+    unsigned word_vocab_size = 0) {
+  if (word_vocab_size == 0) {
+    word_vocab_size = Token::getDict(Token::FORM).size();
+  }
+  unsigned num_labels = Token::getDict(Token::DEPREL).size();
+  return std::make_unique<MlpClassifier>(
+      model,
+      word_vocab_size, 32, Feature::kNWordFeatures,
+      Token::getDict(Token::POSTAG).size(), 16, Feature::kNPosFeatures,
+      num_labels, 16, Feature::kNLabelFeatures,
+      128, 32, Transition::numActions(num_labels));
+}
+
+inline std::shared_ptr<NativeMlpClassifier> createClassifier(
+    dynet::ParameterCollection& model,  // NOLINT(runtime/references)
+    unsigned word_vocab_size = 0) {
+  return std::make_shared<NativeMlpClassifier>(
+      *createMlp(model, word_vocab_size));
+}
+
+// Draws feature vectors with ids uniform over the given vocabulary sizes.
+inline std::vector<FeatureVector> sampleFeatures(
+    size_t size, unsigned word_vocab_size, unsigned pos_vocab_size,
+    unsigned label_vocab_size, std::mt19937* engine) {
+  std::uniform_int_distribution<unsigned> word(0, word_vocab_size - 1);
+  std::uniform_int_distribution<unsigned> pos(0, pos_vocab_size - 1);
+  std::uniform_int_distribution<unsigned> label(0, label_vocab_size - 1);
+  std::vector<FeatureVector> features(size);
+  for (auto& feature : features) {
+    for (unsigned i = 0; i < Feature::kNWordFeatures; ++i) {
+      feature.push_back(word(*engine));
+    }
+    for (unsigned i = 0; i < Feature::kNPosFeatures; ++i) {
+      feature.push_back(pos(*engine));
+    }
+    for (unsigned i = 0; i < Feature::kNLabelFeatures; ++i) {
+      feature.push_back(label(*engine));
+    }
+  }
+  return features;
+}
+
+}  // namespace synthetic
+
+#endif  // TEST_SYNTHETIC_H_
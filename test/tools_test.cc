@@ -0,0 +1,308 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/tools.h>
+#include <gtest/gtest.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace transitionparser;  // NOLINT(build/namespaces)
+
+namespace {
+
+// Returns the peak resident set size of the process in megabytes.
+double peak_rss() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+}  // namespace
+
+class ToolsTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    filepath_ = ::testing::TempDir() + "tools_test.conll";
+  }
+
+  virtual void TearDown() {
+    std::remove(filepath_.c_str());
+  }
+
+  // Writes random sentences until the file reaches about `size` bytes.
+  void writeConll(size_t size) {
+    std::ofstream ofs(filepath_);
+    std::mt19937 engine;
+    std::uniform_int_distribution<int> length(1, 40);
+    std::uniform_int_distribution<int> word(0, 49999);
+    size_t written = 0;
+    while (written < size) {
+      int n = length(engine);
+      std::string sentence;
+      for (int i = 1; i <= n; ++i) {
+        int w = word(engine);
+        sentence += std::to_string(i) + "\tw" + std::to_string(w) + "\t_\tT"
+            + std::to_string(w % 45) + "\tT" + std::to_string(w % 45)
+            + "\t_\t" + std::to_string(i - 1) + "\tl" + std::to_string(w % 40)
+            + "\t_\t_\n";
+      }
+      sentence += "\n";
+      ofs << sentence;
+      written += sentence.size();
+    }
+  }
+
+  std::string filepath_;
+};
+
+TEST_F(ToolsTest, MissingFileThrows) {
+  EXPECT_THROW(tools::read_conll(filepath_ + ".missing"), std::runtime_error);
+  EXPECT_THROW(tools::read_conll_corpus(filepath_ + ".missing"),
+               std::runtime_error);
+}
+
+TEST_F(ToolsTest, MappedReaderMatchesStreamReader) {
+  writeConll(1 << 20);
+  auto mapped = tools::read_conll(filepath_);
+  std::ifstream ifs(filepath_);
+  auto streamed = tools::read_conll(ifs);
+  ASSERT_EQ(streamed.size(), mapped.size());
+  for (size_t i = 0; i < mapped.size(); ++i) {
+    ASSERT_EQ(streamed[i].length, mapped[i].length);
+    for (unsigned j = 0; j < mapped[i].length; ++j) {
+      const Token& expected = streamed[i].tokens[j];
+      const Token& actual = mapped[i].tokens[j];
+      EXPECT_EQ(expected.id, actual.id);
+      EXPECT_EQ(expected.form, actual.form);
+      EXPECT_EQ(expected.head, actual.head);
+      EXPECT_EQ(expected.word, actual.word);
+      EXPECT_EQ(expected.tag, actual.tag);
+      EXPECT_EQ(expected.label, actual.label);
+    }
+  }
+}
+
+TEST_F(ToolsTest, CorpusMatchesSentences) {
+  writeConll(1 << 20);
+  auto sentences = tools::read_conll(filepath_);
+  Corpus corpus = tools::read_conll_corpus(filepath_);
+  ASSERT_EQ(sentences.size(), corpus.size());
+  size_t num_tokens = 0;
+  for (size_t i = 0; i < corpus.size(); ++i) {
+    SentenceView view = corpus[i];
+    const Sentence& sentence = sentences[i];
+    ASSERT_EQ(sentence.id, view.id);
+    ASSERT_EQ(sentence.length, view.length);
+    num_tokens += view.length;
+    for (unsigned j = 0; j < view.length; ++j) {
+      EXPECT_EQ(sentence.tokens[j].word, view.words[j]);
+      EXPECT_EQ(sentence.tokens[j].tag, view.tags[j]);
+      EXPECT_EQ(sentence.tokens[j].label, view.labels[j]);
+      EXPECT_EQ(sentence.tokens[j].head, view.heads[j]);
+    }
+    // the oracle and the features only depend on the ids
+    State expected(sentence);
+    State actual(view);
+    while (!Transition::isTerminal(expected)) {
+      Action action = Transition::getOracle(expected);
+      ASSERT_EQ(action, Transition::getOracle(actual));
+      ASSERT_EQ(Feature::extract(expected), Feature::extract(actual));
+      Transition::apply(action, &expected);
+      Transition::apply(action, &actual);
+    }
+  }
+  EXPECT_EQ(num_tokens, corpus.numTokens());
+}
+
+// Reads a file in chunks, parses each sentence with the oracle and checks
+// that writing it back reproduces the input.
+TEST_F(ToolsTest, ChunkReaderRoundTrip) {
+  writeConll(1 << 18);
+  std::ifstream expected_stream(filepath_);
+  auto expected = tools::read_conll(expected_stream);
+  std::ifstream ifs(filepath_);
+  tools::ConllChunkReader reader(ifs);
+  std::vector<Sentence> sentences;
+  std::vector<std::string> lines;
+  std::string written;
+  size_t num_sentences = 0;
+  while (reader.read(7, &sentences, &lines)) {
+    ASSERT_LE(sentences.size(), 7u);
+    size_t offset = 0;
+    for (const auto& sentence : sentences) {
+      ASSERT_EQ(expected[num_sentences].id, sentence.id);
+      ASSERT_EQ(expected[num_sentences].length, sentence.length);
+      ++num_sentences;
+      State state(sentence);
+      while (!Transition::isTerminal(state)) {
+        Transition::apply(Transition::getOracle(state), &state);
+      }
+      tools::write_conll(state, lines.data() + offset, &written);
+      offset += sentence.length - 1;
+    }
+    ASSERT_EQ(offset, lines.size());
+  }
+  EXPECT_EQ(expected.size(), num_sentences);
+
+  // a label outside a fixed dictionary comes back as the unknown label
+  std::ifstream original(filepath_);
+  std::istringstream actual(written);
+  const Token::Dict& labels = Token::getDict(Token::DEPREL);
+  std::string expected_line, actual_line;
+  while (std::getline(original, expected_line)) {
+    ASSERT_TRUE(std::getline(actual, actual_line));
+    auto expected_fields = utility::string::split(expected_line, '\t');
+    auto actual_fields = utility::string::split(actual_line, '\t');
+    ASSERT_EQ(expected_fields.size(), actual_fields.size());
+    for (size_t j = 0; j < expected_fields.size(); ++j) {
+      if (j != Token::DEPREL || labels.contains(expected_fields[j])) {
+        EXPECT_EQ(expected_fields[j], actual_fields[j]);
+      }
+    }
+  }
+  EXPECT_FALSE(std::getline(actual, actual_line));
+}
+
+TEST_F(ToolsTest, DISABLED_ReaderThroughput) {
+  using clock = std::chrono::steady_clock;
+  const size_t size = 64 << 20;
+  writeConll(size);
+  {
+    auto start = clock::now();
+    auto sentences = tools::read_conll(filepath_);
+    double elapsed = std::chrono::duration<double>(
+        clock::now() - start).count();
+    std::cout << "mmap:   " << (size >> 20) / elapsed << " MB/sec, "
+              << sentences.size() << " sentences" << std::endl;
+  }
+  {
+    auto start = clock::now();
+    std::ifstream ifs(filepath_);
+    auto sentences = tools::read_conll(ifs);
+    double elapsed = std::chrono::duration<double>(
+        clock::now() - start).count();
+    std::cout << "stream: " << (size >> 20) / elapsed << " MB/sec, "
+              << sentences.size() << " sentences" << std::endl;
+  }
+}
+
+TEST_F(ToolsTest, BatchIndicesCoverSamples) {
+  const size_t size = 1000;
+  tools::BatchIndices batches(size, 64);
+  ASSERT_EQ(16u, batches.size());
+  EXPECT_EQ(64u, batches[0].size);
+  EXPECT_EQ(size % 64, batches[batches.size() - 1].size);
+  std::vector<size_t> previous;
+  for (int epoch = 0; epoch < 2; ++epoch) {
+    if (epoch > 0) batches.shuffle();
+    std::vector<size_t> seen;
+    for (size_t b = 0; b < batches.size(); ++b) {
+      seen.insert(seen.end(), batches[b].indices,
+                  batches[b].indices + batches[b].size);
+    }
+    EXPECT_NE(previous, seen);
+    previous = seen;
+    std::sort(seen.begin(), seen.end());
+    for (size_t i = 0; i < size; ++i) {
+      ASSERT_EQ(i, seen[i]);
+    }
+  }
+
+  std::vector<int> x(size);
+  std::vector<int> y(size);
+  for (size_t i = 0; i < size; ++i) {
+    x[i] = i;
+    y[i] = -static_cast<int>(i);
+  }
+  size_t count = 0;
+  for (const auto& batch : tools::create_batch(x, y, 64)) {
+    ASSERT_EQ(batch.first.size(), batch.second.size());
+    for (size_t i = 0; i < batch.first.size(); ++i) {
+      EXPECT_EQ(-batch.first[i], batch.second[i]);
+    }
+    count += batch.first.size();
+  }
+  EXPECT_EQ(size, count);
+}
+
+// Compares one epoch over `size` feature vectors with the former
+// create_batch, which took the samples by value and copied them again into
+// every batch, against iterating over index batches with a reusable batch
+// buffer.
+void compareEpochSetup(size_t size) {
+  using clock = std::chrono::steady_clock;
+  const size_t batch_size = 32;
+  std::vector<FeatureVector> x(size, FeatureVector(Feature::kNFeatures));
+  std::vector<unsigned> y(size);
+  for (size_t i = 0; i < size; ++i) {
+    x[i][0] = y[i] = i;
+  }
+  unsigned checksum = 0;
+
+  double rss = peak_rss();
+  auto start = clock::now();
+  tools::BatchIndices batches(size, batch_size);
+  double setup = std::chrono::duration<double>(clock::now() - start).count();
+  std::vector<FeatureVector> batch_x;
+  std::vector<unsigned> batch_y;
+  for (size_t b = 0; b < batches.size(); ++b) {
+    tools::gather(x, batches[b], &batch_x);
+    tools::gather(y, batches[b], &batch_y);
+    checksum += batch_x[0][0] + batch_y[0];
+  }
+  double epoch = std::chrono::duration<double>(clock::now() - start).count();
+  std::cout << "indices: setup " << setup << " sec, epoch " << epoch
+            << " sec, peak RSS +" << peak_rss() - rss << " MB" << std::endl;
+
+  rss = peak_rss();
+  start = clock::now();
+  auto copy = [](std::vector<FeatureVector> samples_x,
+                 std::vector<unsigned> samples_y, size_t batch_size) {
+    std::vector<size_t> indices(samples_x.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    std::shuffle(indices.begin(), indices.end(), std::mt19937());
+    std::vector<std::pair<std::vector<FeatureVector>,
+                          std::vector<unsigned>>> batches;
+    for (size_t offset = 0; offset < indices.size(); offset += batch_size) {
+      const size_t n = std::min(indices.size() - offset, batch_size);
+      std::vector<FeatureVector> batch_x(n);
+      std::vector<unsigned> batch_y(n);
+      for (size_t i = 0; i < n; ++i) {
+        batch_x[i] = samples_x[indices[offset + i]];
+        batch_y[i] = samples_y[indices[offset + i]];
+      }
+      batches.emplace_back(std::move(batch_x), std::move(batch_y));
+    }
+    return batches;
+  };
+  auto copied = copy(x, y, batch_size);
+  setup = std::chrono::duration<double>(clock::now() - start).count();
+  for (const auto& batch : copied) {
+    checksum += batch.first[0][0] + batch.second[0];
+  }
+  epoch = std::chrono::duration<double>(clock::now() - start).count();
+  std::cout << "copies:  setup " << setup << " sec, epoch " << epoch
+            << " sec, peak RSS +" << peak_rss() - rss << " MB"
+            << " (checksum " << checksum << ")" << std::endl;
+}
+
+TEST_F(ToolsTest, DISABLED_EpochSetup) {
+  compareEpochSetup(5000);
+}
+
+// The size of a treebank, where the copies take over 1 GB.
+TEST_F(ToolsTest, DISABLED_EpochSetupLarge) {
+  compareEpochSetup(2000000);
+}
@@ -10,6 +10,15 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include <chrono>  // NOLINT(build/c++11)
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "synthetic.h"
+
 using namespace transitionparser;  // NOLINT(build/namespaces)
 
 class TransitionTest : public ::testing::Test {
@@ -18,7 +27,10 @@ class TransitionTest : public ::testing::Test {
     std::string filepath =
         "/Users/hiroki/Desktop/NLP/data/archive.20161120/"
             "penn_treebank/dep/stanford/section/parse-train.conll";
-    sentences_ = tools::read_conll(filepath);
+    // the tests run on no sentences where the treebank is not available
+    if (std::ifstream(filepath).good()) {
+      sentences_ = tools::read_conll(filepath);
+    }
   }
 
   virtual void TearDown() {}
@@ -44,3 +56,205 @@ TEST_F(TransitionTest, Oracle) {
     ASSERT_TRUE(correct == state.numTokens());
   }
 }
+
+// Runs the oracle on long synthetic sentences, which must be reproduced
+// exactly.
+TEST(OracleTest, LongSentences) {
+  std::mt19937 engine;
+  for (unsigned length : {100, 1000, 5000}) {
+    Sentence sentence = synthetic::createRandomSentence(1, length, &engine);
+    State state(sentence);
+    while (!Transition::isTerminal(state)) {
+      Transition::apply(Transition::getOracle(state), &state);
+    }
+    for (int i = 1; i < state.numTokens(); ++i) {
+      ASSERT_EQ(state.getToken(i).head, state.head(i));
+      ASSERT_EQ(static_cast<int>(state.getToken(i).label), state.label(i));
+    }
+  }
+}
+
+// Reports the cost of the oracle per token on 50000 tokens of each length.
+TEST(OracleTest, DISABLED_LongSentenceTime) {
+  using clock = std::chrono::steady_clock;
+  std::mt19937 engine;
+  for (unsigned length : {100, 1000, 5000}) {
+    std::vector<Sentence> sentences;
+    for (unsigned num_tokens = 0; num_tokens < 50000; num_tokens += length) {
+      sentences.push_back(synthetic::createRandomSentence(
+          sentences.size() + 1, length, &engine));
+    }
+    double elapsed = 0.0;
+    for (const auto& sentence : sentences) {
+      State state(sentence);
+      auto start = clock::now();
+      while (!Transition::isTerminal(state)) {
+        Transition::apply(Transition::getOracle(state), &state);
+      }
+      elapsed += std::chrono::duration<double, std::nano>(
+          clock::now() - start).count();
+    }
+    std::cout << "length=" << length << ": "
+              << elapsed / (sentences.size() * length) << " ns/token"
+              << std::endl;
+  }
+}
+
+// Checks on the treebank that a forced action is the one the oracle takes.
+TEST_F(TransitionTest, ForcedActions) {
+  for (auto& sentence : sentences_) {
+    State state(sentence);
+    while (!Transition::isTerminal(state)) {
+      Action action = Transition::getOracle(state);
+      Action forced = Transition::forcedAction(state);
+      if (forced != NoneAction) {
+        ASSERT_EQ(forced, action);
+      }
+      Transition::apply(action, &state);
+    }
+  }
+}
+
+// Reports the share of the oracle steps on the treebank that need no scores,
+// which the greedy parser takes without the classifier.
+TEST_F(TransitionTest, DISABLED_ForcedActionShare) {
+  size_t num_steps = 0;
+  size_t num_forced = 0;
+  for (auto& sentence : sentences_) {
+    State state(sentence);
+    while (!Transition::isTerminal(state)) {
+      if (Transition::forcedAction(state) != NoneAction) {
+        ++num_forced;
+      }
+      ++num_steps;
+      Transition::apply(Transition::getOracle(state), &state);
+    }
+  }
+  if (num_steps > 0) {
+    std::cout << static_cast<double>(num_forced) / num_steps
+              << " of the steps are forced" << std::endl;
+  }
+}
+
+namespace {
+
+const int kNumMaskLabels = 40;
+
+// Returns the states along random walks over synthetic sentences; every
+// state of a walk is kept, so each step copies the state.
+std::vector<std::unique_ptr<State>> createWalkStates(
+    std::vector<Sentence>* sentences, std::mt19937* engine) {
+  std::uniform_int_distribution<int> label(0, kNumMaskLabels - 1);
+  std::uniform_int_distribution<int> coin(0, 2);
+  for (int i = 0; i < 200; ++i) {
+    sentences->push_back(
+        synthetic::createRandomSentence(i + 1, 1 + i % 60, engine));
+  }
+  std::vector<std::unique_ptr<State>> states;
+  for (const auto& sentence : *sentences) {
+    auto state = std::make_unique<State>(sentence);
+    while (!Transition::isTerminal(*state)) {
+      Action action = Transition::shiftAction();
+      int choice = coin(*engine);
+      if (choice == 1 && Transition::isAllowedLeft(*state)) {
+        action = Transition::leftAction(label(*engine));
+      } else if (choice != 0 && Transition::isAllowedRight(*state)) {
+        action = Transition::rightAction(label(*engine));
+      } else if (!Transition::isAllowedShift(*state)) {
+        action = Transition::rightAction(label(*engine));
+      }
+      auto next = Transition::successor(action, *state);
+      states.push_back(std::move(state));
+      state = std::move(next);
+    }
+  }
+  return states;
+}
+
+// Returns a row of scores per state, rounded so that ties, which go to the
+// lowest action, are common.
+std::vector<float> createScores(size_t num_states, int num_actions,
+                                std::mt19937* engine) {
+  std::normal_distribution<float> score(0.0f, 1.0f);
+  std::vector<float> scores(num_states * num_actions);
+  for (auto& value : scores) {
+    value = std::round(score(*engine) * 4.0f) / 4.0f;
+  }
+  return scores;
+}
+
+// Tests every action of the row of each state.
+void scanBest(const std::vector<std::unique_ptr<State>>& states,
+              const std::vector<float>& scores, int num_actions,
+              std::vector<Action>* best) {
+  for (size_t i = 0; i < states.size(); ++i) {
+    const float* row = scores.data() + i * num_actions;
+    Action best_action = NoneAction;
+    float best_score = -INFINITY;
+    for (int action = 0; action < num_actions; ++action) {
+      if (row[action] > best_score &&
+          Transition::isAllowed(action, *states[i])) {
+        best_action = action;
+        best_score = row[action];
+      }
+    }
+    (*best)[i] = best_action;
+  }
+}
+
+void maskBest(const std::vector<std::unique_ptr<State>>& states,
+              const std::vector<float>& scores, int num_actions,
+              std::vector<Action>* best) {
+  for (size_t i = 0; i < states.size(); ++i) {
+    (*best)[i] = Transition::bestAllowed(
+        scores.data() + i * num_actions, num_actions,
+        Transition::allowedActionTypes(*states[i]));
+  }
+}
+
+}  // namespace
+
+// Compares the masked argmax with testing every action of a score row on
+// states taken along random walks.
+TEST(MaskTest, BestAllowed) {
+  std::mt19937 engine;
+  const int num_actions = Transition::numActions(kNumMaskLabels);
+  std::vector<Sentence> sentences;
+  auto states = createWalkStates(&sentences, &engine);
+  std::vector<float> scores = createScores(states.size(), num_actions,
+                                           &engine);
+  std::vector<Action> expected(states.size());
+  std::vector<Action> actual(states.size());
+  scanBest(states, scores, num_actions, &expected);
+  maskBest(states, scores, num_actions, &actual);
+  EXPECT_EQ(expected, actual);
+}
+
+// Reports the cost per decision of both ways over 20 passes.
+TEST(MaskTest, DISABLED_BestAllowedTime) {
+  using clock = std::chrono::steady_clock;
+  std::mt19937 engine;
+  const int num_actions = Transition::numActions(kNumMaskLabels);
+  std::vector<Sentence> sentences;
+  auto states = createWalkStates(&sentences, &engine);
+  std::vector<float> scores = createScores(states.size(), num_actions,
+                                           &engine);
+  std::vector<Action> best(states.size());
+  double scan_time = 0.0;
+  double mask_time = 0.0;
+  for (int repeat = 0; repeat < 20; ++repeat) {
+    auto start = clock::now();
+    scanBest(states, scores, num_actions, &best);
+    auto middle = clock::now();
+    maskBest(states, scores, num_actions, &best);
+    auto end = clock::now();
+    scan_time += std::chrono::duration<double, std::nano>(
+        middle - start).count();
+    mask_time += std::chrono::duration<double, std::nano>(
+        end - middle).count();
+  }
+  const double num_decisions = 20.0 * states.size();
+  std::cout << "scan: " << scan_time / num_decisions << " ns/step, "
+            << "masked argmax: " << mask_time / num_decisions << " ns/step"
+            << std::endl;
+}
@@ -0,0 +1,53 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include <transitionparser/utility.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+
+TEST(ProcessTest, ForkJoin) {
+  // the children see memory mapped as shared before the fork
+  const unsigned n = 4;
+  void* addr = mmap(nullptr, sizeof(std::atomic<int>), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(MAP_FAILED, addr);
+  auto* counter = new (addr) std::atomic<int>(0);
+  auto results = utility::process::fork_join<double>(n, [counter](unsigned k) {
+    for (int i = 0; i < 1000; ++i) {
+      ++*counter;
+    }
+    return k * 0.5;
+  });
+  ASSERT_EQ(n, results.size());
+  for (unsigned k = 0; k < n; ++k) {
+    EXPECT_EQ(k * 0.5, results[k]);
+  }
+  EXPECT_EQ(1000 * static_cast<int>(n), counter->load());
+  munmap(addr, sizeof(std::atomic<int>));
+}
+
+TEST(ProcessTest, ForkJoinFailure) {
+  EXPECT_THROW(utility::process::fork_join<int>(2, [](unsigned k) {
+                 if (k == 1) throw std::runtime_error("expected failure");
+                 return 0;
+               }),
+               std::runtime_error);
+}
+
+TEST(ThreadTest, WorkerRethrows) {
+  utility::thread::Worker worker;
+  worker.run([]() { throw std::runtime_error("expected failure"); });
+  EXPECT_THROW(worker.wait(), std::runtime_error);
+  // the error is reported once, and the worker takes the next task
+  int value = 0;
+  worker.run([&value]() { value = 1; });
+  worker.wait();
+  EXPECT_EQ(1, value);
+}
@@ -0,0 +1,157 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include "transitionparser/allreduce.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>  // NOLINT(build/c++11)
+
+namespace transitionparser {
+
+namespace {
+
+// keeps the slots on separate cache lines
+const size_t kAlignment = 64;
+
+// the number of turns a rank waits between two checks of the other ranks
+const unsigned kSpinsPerCheck = 1024;
+
+size_t align(size_t size) {
+  return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+}  // namespace
+
+SharedAllReduce::SharedAllReduce(const unsigned num_ranks,
+                                 const size_t capacity) :
+    num_ranks_(num_ranks), capacity_(capacity), creator_(getpid()) {
+  TRANSITIONPARSER_ASSERT(num_ranks > 0, "no rank to reduce over");
+  static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_BOOL_LOCK_FREE == 2,
+                "the barrier must work across processes");
+  mapping_size_ = align(sizeof(Control))
+      + (num_ranks + 2) * align(capacity * sizeof(float));
+  void* addr = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    TRANSITIONPARSER_EXCEPTION("cannot map {} bytes of shared memory.",
+                               mapping_size_);
+  }
+  mapping_ = static_cast<char*>(addr);
+  control_ = new (mapping_) Control();
+  control_->count = 0;
+  control_->generation = 0;
+  control_->aborted = false;
+}
+
+SharedAllReduce::~SharedAllReduce() {
+  munmap(mapping_, mapping_size_);
+}
+
+void SharedAllReduce::sum(const unsigned rank, const std::vector<Span>& spans) {
+  size_t size = 0;
+  float* own = reinterpret_cast<float*>(slot(rank));
+  for (const Span& span : spans) {
+    TRANSITIONPARSER_ASSERT(size + span.second <= capacity_,
+                            "the spans exceed the capacity of " << capacity_);
+    std::memcpy(own + size, span.first, span.second * sizeof(float));
+    size += span.second;
+  }
+  float* sums = result(num_sums_++ % 2);
+  wait();
+
+  const size_t begin = size * rank / num_ranks_;
+  const size_t end = size * (rank + 1) / num_ranks_;
+  std::memcpy(sums + begin, own + begin, (end - begin) * sizeof(float));
+  for (unsigned other = 0; other < num_ranks_; ++other) {
+    if (other == rank) continue;
+    const float* values = reinterpret_cast<const float*>(slot(other));
+    for (size_t i = begin; i < end; ++i) {
+      sums[i] += values[i];
+    }
+  }
+  wait();
+
+  size = 0;
+  for (const Span& span : spans) {
+    std::memcpy(span.first, sums + size, span.second * sizeof(float));
+    size += span.second;
+  }
+}
+
+std::vector<unsigned> SharedAllReduce::unite(
+    const unsigned rank, const std::vector<unsigned>& ids) {
+  TRANSITIONPARSER_ASSERT(ids.size() + 1 <= capacity_,
+                          "the ids exceed the capacity of " << capacity_);
+  unsigned* own = reinterpret_cast<unsigned*>(slot(rank));
+  own[0] = ids.size();
+  std::copy(ids.begin(), ids.end(), own + 1);
+  wait();
+
+  std::vector<unsigned> all;
+  for (unsigned other = 0; other < num_ranks_; ++other) {
+    const unsigned* values = reinterpret_cast<const unsigned*>(slot(other));
+    all.insert(all.end(), values + 1, values + 1 + values[0]);
+  }
+  std::sort(all.begin(), all.end());
+  all.erase(std::unique(all.begin(), all.end()), all.end());
+  // the slots are overwritten by the next call
+  wait();
+  return all;
+}
+
+void SharedAllReduce::abort() {
+  control_->aborted = true;
+}
+
+void SharedAllReduce::wait() {
+  const unsigned generation = control_->generation.load();
+  if (control_->count.fetch_add(1) + 1 == num_ranks_) {
+    control_->count = 0;
+    control_->generation.fetch_add(1);
+  } else {
+    for (unsigned spins = 1; control_->generation.load() == generation
+             && !control_->aborted.load(); ++spins) {
+      // a rank that died without calling abort() never arrives
+      if (spins % kSpinsPerCheck == 0 && !ranksAlive()) {
+        abort();
+      }
+      std::this_thread::yield();
+    }
+  }
+  if (control_->aborted) {
+    TRANSITIONPARSER_EXCEPTION("another rank aborted the reduction or died.");
+  }
+}
+
+// Rank 0 looks for an exited child without reaping it, which is left to
+// fork_join_here. A child is reparented once its parent is gone.
+bool SharedAllReduce::ranksAlive() const {
+  if (getpid() != creator_) {
+    return getppid() == creator_;
+  }
+  siginfo_t info;
+  info.si_pid = 0;
+  if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) != 0) {
+    return errno != ECHILD;
+  }
+  return info.si_pid == 0;
+}
+
+char* SharedAllReduce::slot(const unsigned rank) const {
+  return mapping_ + align(sizeof(Control))
+      + rank * align(capacity_ * sizeof(float));
+}
+
+float* SharedAllReduce::result(const unsigned parity) const {
+  return reinterpret_cast<float*>(slot(num_ranks_ + parity));
+}
+
+}  // namespace transitionparser
@@ -0,0 +1,85 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#ifndef TRANSITIONPARSER_ALLREDUCE_H_
+#define TRANSITIONPARSER_ALLREDUCE_H_
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#include "transitionparser/utility.h"
+
+namespace transitionparser {
+
+// Collective operations among `num_ranks` processes on one host, forked
+// after the instance is created so that they share its memory mapping.
+// Every rank must make the same sequence of calls. If a rank calls abort(),
+// the others throw from their pending or next call instead of waiting for
+// it forever. So they do if a rank dies without calling it, e.g. from a
+// signal, provided that the creating process is rank 0 and forks the others,
+// as with utility::process::fork_join_here: while waiting, rank 0 watches
+// its children and the children watch their parent.
+class SharedAllReduce {
+ public:
+  typedef std::pair<float*, size_t> Span;
+
+  // `capacity` is the number of 4-byte values each rank can contribute to
+  // one call.
+  SharedAllReduce(unsigned num_ranks, size_t capacity);
+
+  ~SharedAllReduce();
+
+  // Replaces the values of the spans of every rank with their element-wise
+  // sum over the ranks. The spans must have the same sizes on every rank.
+  // Each rank adds up one chunk of the values (reduce-scatter) and then
+  // copies the whole sum back (all-gather), with two barriers per call.
+  void sum(unsigned rank, const std::vector<Span>& spans);
+
+  // Returns the sorted union of the ids of every rank.
+  std::vector<unsigned> unite(unsigned rank,
+                              const std::vector<unsigned>& ids);
+
+  void abort();
+
+  unsigned numRanks() const {
+    return num_ranks_;
+  }
+
+ private:
+  struct Control {
+    std::atomic<unsigned> count;
+    std::atomic<unsigned> generation;
+    std::atomic<bool> aborted;
+  };
+
+  // Blocks until every rank has reached the barrier.
+  void wait();
+
+  // Returns false if a rank is known to have exited.
+  bool ranksAlive() const;
+
+  char* slot(unsigned rank) const;
+
+  float* result(unsigned parity) const;
+
+  const unsigned num_ranks_;
+  const size_t capacity_;
+  const pid_t creator_;
+  size_t mapping_size_;
+  char* mapping_;
+  Control* control_;
+  // the sums alternate between two buffers, so that a rank may start the
+  // next sum while another is still copying the previous one back
+  unsigned num_sums_ = 0;
+
+  DISALLOW_COPY_AND_MOVE(SharedAllReduce);
+};
+
+}  // namespace transitionparser
+
+#endif  // TRANSITIONPARSER_ALLREDUCE_H_
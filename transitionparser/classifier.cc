@@ -6,11 +6,28 @@
 #include "transitionparser/classifier.h"
 
 #include <dynet/expr.h>
+#include <dynet/tensor.h>
+
+#include <algorithm>
+#include <vector>
 
 #include "transitionparser/logger.h"
 
 namespace transitionparser {
 
+void Classifier::compute_batch(const FeatureMatrix& features,
+                               std::vector<float>* scores) {
+  std::vector<FeatureVector> rows;
+  rows.reserve(features.batchSize());
+  for (size_t i = 0; i < features.batchSize(); ++i) {
+    rows.push_back(features.row(i));
+  }
+  scores->clear();
+  for (const auto& row_scores : compute_batch(rows)) {
+    scores->insert(scores->end(), row_scores.begin(), row_scores.end());
+  }
+}
+
 void NeuralClassifier::prepare(dynet::ComputationGraph* cg) {
   cg_ = cg;
 }
@@ -18,7 +35,8 @@ void NeuralClassifier::prepare(dynet::ComputationGraph* cg) {
 std::vector<float> NeuralClassifier::compute(const FeatureVector& feature) {
   LOG_TRACE("feature: {}", feature);
   cg_->clear();
-  return dynet::as_vector(cg_->forward(run({feature})));
+  FeatureMatrix X(std::vector<FeatureVector>{feature});
+  return dynet::as_vector(cg_->forward(run(X)));
 }
 
 std::vector<std::vector<float>> NeuralClassifier::compute_batch(
@@ -28,7 +46,7 @@ std::vector<std::vector<float>> NeuralClassifier::compute_batch(
   score_matrix.reserve(batch_size);
 
   cg_->clear();
-  auto v = dynet::as_vector(cg_->forward(run(features)));
+  auto v = dynet::as_vector(cg_->forward(run(FeatureMatrix(features))));
   int dim = v.size() / batch_size;
   auto start = v.begin();
   auto end = start + dim;
@@ -41,6 +59,14 @@ std::vector<std::vector<float>> NeuralClassifier::compute_batch(
   return score_matrix;
 }
 
+void NeuralClassifier::compute_batch(const FeatureMatrix& features,
+                                     std::vector<float>* scores) {
+  cg_->clear();
+  const dynet::Tensor& y = cg_->forward(run(features));
+  scores->resize(y.d.size());
+  std::copy_n(y.v, scores->size(), scores->data());
+}
+
 MlpClassifier::MlpClassifier(dynet::ParameterCollection& model,
                              const unsigned word_vocab_size,
                              const unsigned word_embed_size,
@@ -81,18 +107,20 @@ MlpClassifier::MlpClassifier(dynet::ParameterCollection& model,
     p_W3_(model.add_parameters({output_size, hidden2_size})),
     p_b3_(model.add_parameters({output_size})) {}
 
-dynet::Expression MlpClassifier::run(const std::vector<FeatureVector>& X) {
+// Each slot of the matrix is looked up for the whole batch at once.
+dynet::Expression MlpClassifier::run(const FeatureMatrix& X) {
+  const size_t batch_size = X.batchSize();
   std::vector<dynet::Expression> embeddings;
-  auto feature_tensor = Feature::unpackFeatures(X);
-  for (auto feature_batch : feature_tensor[0]) {
-    embeddings.push_back(dynet::lookup(*cg_, p_lookup_w_, feature_batch));
-  }
-  for (auto feature_batch : feature_tensor[1]) {
-    embeddings.push_back(dynet::lookup(*cg_, p_lookup_p_, feature_batch));
-  }
-  for (auto feature_batch : feature_tensor[2]) {
-    embeddings.push_back(dynet::lookup(*cg_, p_lookup_l_, feature_batch));
-  }
+  embeddings.reserve(Feature::kNFeatures);
+  unsigned j = 0;
+  auto lookup = [&](dynet::LookupParameter p) {
+    const unsigned* ids = X.slot(j++);
+    embeddings.push_back(dynet::lookup(
+        *cg_, p, std::vector<unsigned>(ids, ids + batch_size)));
+  };
+  for (unsigned i = 0; i < word_feature_size_; ++i) lookup(p_lookup_w_);
+  for (unsigned i = 0; i < pos_feature_size_; ++i) lookup(p_lookup_p_);
+  for (unsigned i = 0; i < label_feature_size_; ++i) lookup(p_lookup_l_);
   dynet::Expression h0 = dynet::concatenate(embeddings);
 
   dynet::Expression W1 = dynet::parameter(*cg_, p_W1_);
@@ -30,6 +30,16 @@ class Classifier {
   virtual std::vector<std::vector<float>> compute_batch(
       const std::vector<FeatureVector>& features) = 0;
 
+  // Writes the scores of the batch to `scores` row by row, i.e. the scores
+  // of the i-th sample start at i * scores->size() / features.batchSize().
+  // The buffer is resized as needed so that it can be reused across steps.
+  virtual void compute_batch(const FeatureMatrix& features,
+                             std::vector<float>* scores);
+
+  // Whether compute and compute_batch may be called from several threads at
+  // once. NeuralClassifier is not, since it shares one computation graph.
+  virtual bool isThreadSafe() const { return false; }
+
  private:
   DISALLOW_COPY_AND_MOVE(Classifier);
 };
@@ -43,7 +53,10 @@ class NeuralClassifier : public Classifier {
   std::vector<std::vector<float>> compute_batch(
       const std::vector<FeatureVector>& features) override;
 
-  virtual dynet::Expression run(const std::vector<FeatureVector>& X) = 0;
+  void compute_batch(const FeatureMatrix& features,
+                     std::vector<float>* scores) override;
+
+  virtual dynet::Expression run(const FeatureMatrix& X) = 0;
 
  protected:
   dynet::ComputationGraph* cg_ = nullptr;
@@ -65,9 +78,11 @@ class MlpClassifier : public NeuralClassifier {
                 const unsigned hidden2_size,
                 const unsigned output_size);
 
-  dynet::Expression run(const std::vector<FeatureVector>& X) override;
+  dynet::Expression run(const FeatureMatrix& X) override;
 
  protected:
+  friend class NativeMlpClassifier;
+
   const unsigned word_vocab_size_;
   const unsigned word_embed_size_;
   const unsigned word_feature_size_;
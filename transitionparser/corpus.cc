@@ -0,0 +1,85 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include "transitionparser/corpus.h"
+
+#include <vector>
+
+namespace transitionparser {
+
+Corpus::Corpus() : offsets_{0} {}
+
+Corpus::Corpus(const std::vector<Sentence>& sentences) : Corpus() {
+  for (const auto& sentence : sentences) {
+    // the root is added by push_back
+    for (unsigned i = 1; i < sentence.length; ++i) {
+      push_back(sentence.tokens[i].ids());
+    }
+    close();
+  }
+}
+
+void Corpus::push_back(const Token::Ids& ids) {
+  if (words_.size() == offsets_.back()) {
+    const Token& root = Token::createRoot();
+    words_.push_back(root.word);
+    tags_.push_back(root.tag);
+    labels_.push_back(root.label);
+    heads_.push_back(root.head);
+  }
+  words_.push_back(ids.word);
+  tags_.push_back(ids.tag);
+  labels_.push_back(ids.label);
+  heads_.push_back(ids.head);
+}
+
+void Corpus::close() {
+  const size_t offset = offsets_.back();
+  const size_t length = words_.size() - offset;
+  if (length == 0) return;
+  children_.resize(words_.size(), 0);
+  for (size_t i = offset + 1; i < words_.size(); ++i) {
+    const int head = heads_[i];
+    if (head >= 0 && static_cast<size_t>(head) < length) {
+      ++children_[offset + head];
+    }
+  }
+  offsets_.push_back(words_.size());
+}
+
+void Corpus::shrink_to_fit() {
+  words_.shrink_to_fit();
+  tags_.shrink_to_fit();
+  labels_.shrink_to_fit();
+  heads_.shrink_to_fit();
+  children_.shrink_to_fit();
+  offsets_.shrink_to_fit();
+}
+
+SentenceView Corpus::operator[](size_t index) const {
+  const size_t offset = offsets_[index];
+  return {static_cast<int>(index + 1),
+          static_cast<unsigned>(offsets_[index + 1] - offset),
+          words_.data() + offset, tags_.data() + offset,
+          labels_.data() + offset, heads_.data() + offset,
+          children_.data() + offset};
+}
+
+SentenceView Corpus::at(size_t index) const {
+  if (index >= size()) {
+    TRANSITIONPARSER_EXCEPTION("index {} is out of range.", index);
+  }
+  return (*this)[index];
+}
+
+size_t Corpus::size() const {
+  return offsets_.size() - 1;
+}
+
+size_t Corpus::numTokens() const {
+  return offsets_.back();
+}
+
+}  // namespace transitionparser
@@ -0,0 +1,58 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#ifndef TRANSITIONPARSER_CORPUS_H_
+#define TRANSITIONPARSER_CORPUS_H_
+
+#include <vector>
+
+#include "transitionparser/sentence.h"
+#include "transitionparser/token.h"
+#include "transitionparser/utility.h"
+
+namespace transitionparser {
+
+// Columnar storage of the ids of many sentences. The ids of all tokens are
+// kept in four flat arrays with one offset per sentence, and the strings are
+// only kept once in the dictionaries of Token. Every sentence starts with
+// the root as a Sentence does.
+class Corpus {
+ public:
+  Corpus();
+  explicit Corpus(const std::vector<Sentence>& sentences);
+  DISALLOW_COPY_AND_ASSIGN(Corpus);
+  DEFAULT_MOVE_AND_ASSIGN(Corpus);
+  ~Corpus() {}
+
+  // Appends a token to the sentence being built.
+  void push_back(const Token::Ids& ids);
+
+  // Ends the sentence being built, if any, and counts its dependents.
+  void close();
+
+  // Releases the spare capacity of the arrays once reading is finished.
+  void shrink_to_fit();
+
+  SentenceView operator[](size_t index) const;
+
+  SentenceView at(size_t index) const;
+
+  size_t size() const;
+
+  size_t numTokens() const;
+
+ private:
+  std::vector<unsigned> words_;
+  std::vector<unsigned> tags_;
+  std::vector<unsigned> labels_;
+  std::vector<int> heads_;
+  std::vector<unsigned> children_;
+  // offsets_[i] is the position of the root of the i-th sentence
+  std::vector<size_t> offsets_;
+};
+
+}  // namespace transitionparser
+
+#endif  // TRANSITIONPARSER_CORPUS_H_
@@ -0,0 +1,303 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include "transitionparser/dataset.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "transitionparser/logger.h"
+
+namespace transitionparser {
+
+namespace {
+
+// Reads the size and the modification time, in nanoseconds, of a file.
+bool stat_source(const std::string& filepath, uint64_t* size,
+                 int64_t* mtime) {
+  struct stat st;
+  if (filepath.empty() || ::stat(filepath.c_str(), &st) != 0) return false;
+  *size = static_cast<uint64_t>(st.st_size);
+  *mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000
+      + st.st_mtim.tv_nsec;
+  return true;
+}
+
+// Returns one more than the largest label id of the corpus.
+unsigned count_labels(const Corpus& corpus) {
+  unsigned num_labels = 0;
+  for (size_t i = 0; i < corpus.size(); ++i) {
+    SentenceView sentence = corpus[i];
+    for (unsigned j = 0; j < sentence.length; ++j) {
+      num_labels = std::max(num_labels, sentence.labels[j] + 1);
+    }
+  }
+  return num_labels;
+}
+
+template <typename T>
+void write_records(std::ostream& os, const Corpus& corpus) {
+  T record[1 + Feature::kNFeatures];
+  for_each_example(corpus, [&](const unsigned* features, Action action) {
+    record[0] = static_cast<T>(action);
+    std::copy_n(features, Feature::kNFeatures, record + 1);
+    os.write(reinterpret_cast<const char*>(record), sizeof(record));
+  });
+}
+
+}  // namespace
+
+InMemoryExamples::InMemoryExamples(const Corpus& corpus) {
+  // arc-standard takes exactly 2n transitions for n words
+  const size_t num_examples = 2 * (corpus.numTokens() - corpus.size());
+  features_.reserve(num_examples * Feature::kNFeatures);
+  actions_.reserve(num_examples);
+  for_each_example(corpus, [this](const unsigned* features, Action action) {
+    features_.insert(features_.end(), features,
+                     features + Feature::kNFeatures);
+    actions_.push_back(static_cast<unsigned>(action));
+  });
+}
+
+size_t InMemoryExamples::size() const {
+  return actions_.size();
+}
+
+void InMemoryExamples::gather(const size_t* indices, size_t n,
+                              FeatureMatrix* features,
+                              std::vector<unsigned>* actions) const {
+  features->resize(n);
+  actions->resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    features->set(i, features_.data() + indices[i] * Feature::kNFeatures);
+    (*actions)[i] = actions_[indices[i]];
+  }
+}
+
+ReplayExamples::ReplayExamples(const Corpus& corpus) : corpus_(corpus) {
+  // the actions are stored as narrow as the labels of the corpus allow
+  const int num_actions = Transition::numActions(count_labels(corpus));
+  TRANSITIONPARSER_ASSERT(
+      num_actions <= std::numeric_limits<uint16_t>::max() + 1,
+      num_actions << " actions do not fit in two bytes");
+  if (num_actions <= std::numeric_limits<uint8_t>::max() + 1) {
+    record(corpus, &byte_actions_);
+  } else {
+    record(corpus, &short_actions_);
+  }
+}
+
+template <typename T>
+void ReplayExamples::record(const Corpus& corpus, std::vector<T>* actions) {
+  actions->reserve(2 * (corpus.numTokens() - corpus.size()));
+  offsets_.reserve(corpus.size() + 1);
+  for (size_t i = 0; i < corpus.size(); ++i) {
+    offsets_.push_back(actions->size());
+    State state(corpus[i]);
+    while (!Transition::isTerminal(state)) {
+      Action action = Transition::getOracle(state);
+      actions->push_back(static_cast<T>(action));
+      Transition::apply(action, &state);
+    }
+  }
+  offsets_.push_back(actions->size());
+}
+
+size_t ReplayExamples::size() const {
+  return offsets_.back();
+}
+
+void ReplayExamples::gather(const size_t* indices, size_t n,
+                            FeatureMatrix* features,
+                            std::vector<unsigned>* actions) const {
+  static thread_local std::vector<Request> requests;
+  requests.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    const size_t sentence = std::upper_bound(
+        offsets_.begin(), offsets_.end(), indices[i]) - offsets_.begin() - 1;
+    requests[i] = {sentence, indices[i] - offsets_[sentence], i};
+  }
+  std::sort(requests.begin(), requests.end(),
+            [](const Request& lhs, const Request& rhs) {
+              return lhs.sentence < rhs.sentence
+                  || (lhs.sentence == rhs.sentence && lhs.step < rhs.step);
+            });
+  features->resize(n);
+  actions->resize(n);
+  replay(requests.data(), requests.data() + n, features, actions);
+}
+
+void ReplayExamples::replay(const Request* begin, const Request* end,
+                            FeatureMatrix* features,
+                            std::vector<unsigned>* actions) const {
+  if (short_actions_.empty()) {
+    replayAs(byte_actions_.data(), begin, end, features, actions);
+  } else {
+    replayAs(short_actions_.data(), begin, end, features, actions);
+  }
+}
+
+template <typename T>
+void ReplayExamples::replayAs(const T* gold_actions, const Request* begin,
+                              const Request* end, FeatureMatrix* features,
+                              std::vector<unsigned>* actions) const {
+  while (begin < end) {
+    const size_t sentence = begin->sentence;
+    const T* gold = gold_actions + offsets_[sentence];
+    State state(corpus_[sentence]);
+    size_t step = 0;
+    for (; begin < end && begin->sentence == sentence; ++begin) {
+      for (; step < begin->step; ++step) {
+        Transition::apply(gold[step], &state);
+      }
+      features->set(begin->row, state);
+      (*actions)[begin->row] = gold[step];
+    }
+  }
+}
+
+const char MappedExamples::kMagic[8] = {
+    'T', 'P', 'O', 'R', 'A', 'C', 'L', 'E'};
+const uint32_t MappedExamples::kVersion = 2;
+
+MappedExamples::MappedExamples(const std::string& filepath) {
+  if (!file_.open(filepath)) {
+    TRANSITIONPARSER_EXCEPTION("cannot open '{}'.", filepath);
+  }
+  if (file_.size() < sizeof(Header)) {
+    TRANSITIONPARSER_EXCEPTION("'{}' is not an example file.", filepath);
+  }
+  std::memcpy(&header_, file_.data(), sizeof(Header));
+  if (std::memcmp(header_.magic, kMagic, sizeof(kMagic)) != 0
+      || header_.version != kVersion) {
+    TRANSITIONPARSER_EXCEPTION("'{}' is not an example file of version {}.",
+                               filepath, kVersion);
+  }
+  if (header_.num_features != Feature::kNFeatures
+      || (header_.id_bytes != 2 && header_.id_bytes != 4)) {
+    TRANSITIONPARSER_EXCEPTION("'{}' has an incompatible feature layout.",
+                               filepath);
+  }
+  record_size_ = (1 + header_.num_features) * header_.id_bytes;
+  if (header_.data_offset + header_.num_examples * record_size_
+      > file_.size()) {
+    TRANSITIONPARSER_EXCEPTION("'{}' is truncated.", filepath);
+  }
+  // the batches are sampled at random
+  madvise(const_cast<char*>(file_.data()), file_.size(), MADV_RANDOM);
+}
+
+void MappedExamples::write(const std::string& filepath,
+                           const Corpus& corpus, const std::string& source) {
+  std::ofstream ofs(filepath, std::ios::binary | std::ios::trunc);
+  if (!ofs) {
+    TRANSITIONPARSER_EXCEPTION("cannot open '{}'.", filepath);
+  }
+  std::ostringstream dicts;
+  Token::saveDictionaries(dicts);
+  const std::string dict = dicts.str();
+
+  Header header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  // the ids and the actions share the width of a record
+  const unsigned num_labels = std::max<unsigned>(
+      Token::getDict(Token::DEPREL).size(), count_labels(corpus));
+  const size_t max_size = std::max<size_t>({
+      Token::getDict(Token::FORM).size(), Token::getDict(Token::POSTAG).size(),
+      num_labels,
+      static_cast<size_t>(Transition::numActions(num_labels))});
+  header.id_bytes = max_size <= std::numeric_limits<uint16_t>::max() ? 2 : 4;
+  header.num_features = Feature::kNFeatures;
+  if (!source.empty() &&
+      !stat_source(source, &header.source_size, &header.source_mtime)) {
+    TRANSITIONPARSER_EXCEPTION("cannot open '{}'.", source);
+  }
+  header.dict_offset = sizeof(Header);
+  header.dict_size = dict.size();
+  // records start on an 8-byte boundary
+  header.data_offset = (header.dict_offset + header.dict_size + 7) / 8 * 8;
+
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  ofs.write(dict.data(), dict.size());
+  const std::string padding(
+      header.data_offset - header.dict_offset - header.dict_size, '\0');
+  ofs.write(padding.data(), padding.size());
+  if (header.id_bytes == 2) {
+    write_records<uint16_t>(ofs, corpus);
+  } else {
+    write_records<uint32_t>(ofs, corpus);
+  }
+  const size_t record_size = (1 + Feature::kNFeatures) * header.id_bytes;
+  header.num_examples =
+      (static_cast<uint64_t>(ofs.tellp()) - header.data_offset) / record_size;
+  ofs.seekp(0);
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  if (!ofs) {
+    TRANSITIONPARSER_EXCEPTION("failed to write '{}'.", filepath);
+  }
+  LOG_DEBUG("wrote {} examples of {} bytes to '{}'",
+            header.num_examples, record_size, filepath);
+}
+
+bool MappedExamples::isUpToDate(const std::string& filepath,
+                                const std::string& source) {
+  std::ifstream ifs(filepath, std::ios::binary);
+  Header header;
+  if (!ifs.read(reinterpret_cast<char*>(&header), sizeof(Header))) {
+    return false;
+  }
+  uint64_t size;
+  int64_t mtime;
+  return std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+      && header.version == kVersion
+      && header.num_features == Feature::kNFeatures
+      && stat_source(source, &size, &mtime)
+      && header.source_size == size && header.source_mtime == mtime;
+}
+
+void MappedExamples::loadDictionaries() const {
+  std::istringstream iss(std::string(file_.data() + header_.dict_offset,
+                                     header_.dict_size));
+  Token::loadDictionaries(iss);
+}
+
+size_t MappedExamples::size() const {
+  return header_.num_examples;
+}
+
+void MappedExamples::gather(const size_t* indices, size_t n,
+                            FeatureMatrix* features,
+                            std::vector<unsigned>* actions) const {
+  if (header_.id_bytes == 2) {
+    gatherAs<uint16_t>(indices, n, features, actions);
+  } else {
+    gatherAs<uint32_t>(indices, n, features, actions);
+  }
+}
+
+template <typename T>
+void MappedExamples::gatherAs(const size_t* indices, size_t n,
+                              FeatureMatrix* features,
+                              std::vector<unsigned>* actions) const {
+  const char* data = file_.data() + header_.data_offset;
+  features->resize(n);
+  actions->resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    const T* record =
+        reinterpret_cast<const T*>(data + indices[i] * record_size_);
+    (*actions)[i] = record[0];
+    features->set(i, record + 1);
+  }
+}
+
+}  // namespace transitionparser
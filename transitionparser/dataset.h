@@ -0,0 +1,175 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#ifndef TRANSITIONPARSER_DATASET_H_
+#define TRANSITIONPARSER_DATASET_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "transitionparser/corpus.h"
+#include "transitionparser/feature.h"
+#include "transitionparser/utility.h"
+
+namespace transitionparser {
+
+// The oracle configurations of a corpus, served to the trainer by index.
+class ExampleSource {
+ public:
+  ExampleSource() {}
+  virtual ~ExampleSource() {}
+
+  virtual size_t size() const = 0;
+
+  // Writes the features of the examples at `indices` to the rows of
+  // `features` and their gold actions to `actions`; both are resized to `n`.
+  // May be called from several threads at once.
+  virtual void gather(const size_t* indices, size_t n,
+                      FeatureMatrix* features,
+                      std::vector<unsigned>* actions) const = 0;
+
+ private:
+  DISALLOW_COPY_AND_MOVE(ExampleSource);
+};
+
+// Calls `f(features, action)` for every oracle configuration of the corpus,
+// in order. `features` points to kNFeatures ids valid during the call.
+template <typename F>
+void for_each_example(const Corpus& corpus, F f) {
+  unsigned features[Feature::kNFeatures];
+  for (size_t i = 0; i < corpus.size(); ++i) {
+    State state(corpus[i]);
+    while (!Transition::isTerminal(state)) {
+      Action action = Transition::getOracle(state);
+      Feature::extract(state, features);
+      f(static_cast<const unsigned*>(features), action);
+      Transition::apply(action, &state);
+    }
+  }
+}
+
+// All examples materialized in one flat row-major array.
+class InMemoryExamples : public ExampleSource {
+ public:
+  explicit InMemoryExamples(const Corpus& corpus);
+
+  size_t size() const override;
+
+  void gather(const size_t* indices, size_t n, FeatureMatrix* features,
+              std::vector<unsigned>* actions) const override;
+
+ private:
+  std::vector<unsigned> features_;
+  std::vector<unsigned> actions_;
+};
+
+// Keeps only the gold action sequence of every sentence, one byte per
+// example, or two when the labels of the corpus make more than 256 actions,
+// and regenerates the features of a batch by replaying the actions of its
+// sentences. The corpus must outlive the source. The requested examples are
+// grouped by sentence so that each sentence of a batch is replayed once.
+// A gather runs on the calling thread and costs about five times one from
+// InMemoryExamples; several gathers may run at once, so the workers of a
+// BatchPrefetcher hide it as long as a training step takes longer than a
+// gather divided by their number.
+class ReplayExamples : public ExampleSource {
+ public:
+  explicit ReplayExamples(const Corpus& corpus);
+
+  size_t size() const override;
+
+  void gather(const size_t* indices, size_t n, FeatureMatrix* features,
+              std::vector<unsigned>* actions) const override;
+
+ private:
+  struct Request {
+    size_t sentence;
+    size_t step;
+    size_t row;
+  };
+
+  // Appends the gold actions of every sentence to `actions`.
+  template <typename T>
+  void record(const Corpus& corpus, std::vector<T>* actions);
+
+  // Replays requests[begin, end), which are sorted by sentence and step.
+  void replay(const Request* begin, const Request* end,
+              FeatureMatrix* features, std::vector<unsigned>* actions) const;
+
+  template <typename T>
+  void replayAs(const T* gold_actions, const Request* begin,
+                const Request* end, FeatureMatrix* features,
+                std::vector<unsigned>* actions) const;
+
+  const Corpus& corpus_;
+  // only one of them holds the actions
+  std::vector<uint8_t> byte_actions_;
+  std::vector<uint16_t> short_actions_;
+  // offsets_[i] is the index of the first example of the i-th sentence
+  std::vector<size_t> offsets_;
+};
+
+// Examples read from a binary file written by MappedExamples::write. The file
+// is memory-mapped and the batches are gathered straight from it, so opening
+// it takes no time and only the pages in use stay resident.
+//
+// Layout: a Header, the dictionaries as written by Token::saveDictionaries,
+// then from `data_offset` one record per example: the action and the
+// kNFeatures ids, each `id_bytes` wide.
+class MappedExamples : public ExampleSource {
+ public:
+  explicit MappedExamples(const std::string& filepath);
+
+  // Writes the examples of the corpus with the current dictionaries, using
+  // 2-byte ids when every dictionary has less than 65536 entries. The size
+  // and the modification time of `source`, the file the corpus was read
+  // from, are recorded to tell when the examples are out of date.
+  static void write(const std::string& filepath, const Corpus& corpus,
+                    const std::string& source = "");
+
+  // Returns whether `filepath` holds examples of the current feature layout
+  // written from `source` as it is now.
+  static bool isUpToDate(const std::string& filepath,
+                         const std::string& source);
+
+  // Replaces the Token dictionaries with the ones stored in the file.
+  void loadDictionaries() const;
+
+  size_t size() const override;
+
+  void gather(const size_t* indices, size_t n, FeatureMatrix* features,
+              std::vector<unsigned>* actions) const override;
+
+ private:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t id_bytes;
+    uint32_t num_features;
+    uint32_t reserved;
+    uint64_t num_examples;
+    uint64_t dict_offset;
+    uint64_t dict_size;
+    uint64_t data_offset;
+    uint64_t source_size;
+    int64_t source_mtime;
+  };
+
+  static const char kMagic[8];
+  static const uint32_t kVersion;
+
+  template <typename T>
+  void gatherAs(const size_t* indices, size_t n, FeatureMatrix* features,
+                std::vector<unsigned>* actions) const;
+
+  utility::file::MappedFile file_;
+  Header header_;
+  size_t record_size_;
+};
+
+}  // namespace transitionparser
+
+#endif  // TRANSITIONPARSER_DATASET_H_
@@ -9,134 +9,103 @@
 
 namespace transitionparser {
 
-const unsigned Feature::kNWordFeatures  = 20;
-const unsigned Feature::kNPosFeatures   = 20;
-const unsigned Feature::kNLabelFeatures = 12;
+constexpr unsigned Feature::kNWordFeatures;
+constexpr unsigned Feature::kNPosFeatures;
+constexpr unsigned Feature::kNLabelFeatures;
+constexpr unsigned Feature::kNFeatures;
 
 FeatureVector Feature::extract(const State &state) {
-  Token pad = Token::createPad();
-  const Token& s0 = state.getToken(state.stack(0), pad);
-  const Token& s1 = state.getToken(state.stack(1), pad);
-  const Token& s2 = state.getToken(state.stack(2), pad);
-  const Token& s3 = state.getToken(state.stack(3), pad);
-  const Token& b0 = state.getToken(state.buffer(0), pad);
-  const Token& b1 = state.getToken(state.buffer(1), pad);
-  const Token& b2 = state.getToken(state.buffer(2), pad);
-  const Token& b3 = state.getToken(state.buffer(3), pad);
-
-  const Token& lc1_s0 = state.getToken(state.leftmost(s0.id), pad);
-  const Token& rc1_s0 = state.getToken(state.rightmost(s0.id), pad);
-  const Token& lc2_s0 =
-      state.getToken(state.leftmost(s0.id, lc1_s0.id + 1), pad);
-  const Token& rc2_s0 =
-      state.getToken(state.rightmost(s0.id, rc1_s0.id - 1), pad);
-  const Token& lc1_s1 = state.getToken(state.leftmost(s1.id), pad);
-  const Token& rc1_s1 = state.getToken(state.rightmost(s1.id), pad);
-  const Token& lc2_s1 =
-      state.getToken(state.leftmost(s1.id, lc1_s1.id + 1), pad);
-  const Token& rc2_s1 =
-      state.getToken(state.rightmost(s1.id, rc1_s1.id - 1), pad);
-
-  const Token& lc1_lc1_s0 = state.getToken(state.leftmost(lc1_s0.id), pad);
-  const Token& rc1_rc1_s0 = state.getToken(state.rightmost(rc1_s0.id), pad);
-  const Token& lc1_lc1_s1 = state.getToken(state.leftmost(lc1_s1.id), pad);
-  const Token& rc1_rc1_s1 = state.getToken(state.rightmost(rc1_s1.id), pad);
-
-  return {
-      // word features
-      s0.word,
-      s1.word,
-      s2.word,
-      s3.word,
-      b0.word,
-      b1.word,
-      b2.word,
-      b3.word,
-      lc1_s0.word,
-      rc1_s0.word,
-      lc2_s0.word,
-      rc2_s0.word,
-      lc1_s1.word,
-      rc1_s1.word,
-      lc2_s1.word,
-      rc2_s1.word,
-      lc1_lc1_s0.word,
-      rc1_rc1_s0.word,
-      lc1_lc1_s1.word,
-      rc1_rc1_s1.word,
-      // pos features
-      s0.tag,
-      s1.tag,
-      s2.tag,
-      s3.tag,
-      b0.tag,
-      b1.tag,
-      b2.tag,
-      b3.tag,
-      lc1_s0.tag,
-      rc1_s0.tag,
-      lc2_s0.tag,
-      rc2_s0.tag,
-      lc1_s1.tag,
-      rc1_s1.tag,
-      lc2_s1.tag,
-      rc2_s1.tag,
-      lc1_lc1_s0.tag,
-      rc1_rc1_s0.tag,
-      lc1_lc1_s1.tag,
-      rc1_rc1_s1.tag,
-      // label features
-      lc1_s0.id != -1 ? (unsigned) state.label(lc1_s0.id) : pad.label,
-      rc1_s0.id != -1 ? (unsigned) state.label(rc1_s0.id) : pad.label,
-      lc2_s0.id != -1 ? (unsigned) state.label(lc2_s0.id) : pad.label,
-      rc2_s0.id != -1 ? (unsigned) state.label(rc2_s0.id) : pad.label,
-      lc1_s1.id != -1 ? (unsigned) state.label(lc1_s1.id) : pad.label,
-      rc1_s1.id != -1 ? (unsigned) state.label(rc1_s1.id) : pad.label,
-      lc2_s1.id != -1 ? (unsigned) state.label(lc2_s1.id) : pad.label,
-      rc2_s1.id != -1 ? (unsigned) state.label(rc2_s1.id) : pad.label,
-      lc1_lc1_s0.id != -1 ? (unsigned) state.label(lc1_lc1_s0.id) : pad.label,
-      rc1_rc1_s0.id != -1 ? (unsigned) state.label(rc1_rc1_s0.id) : pad.label,
-      lc1_lc1_s1.id != -1 ? (unsigned) state.label(lc1_lc1_s1.id) : pad.label,
-      rc1_rc1_s1.id != -1 ? (unsigned) state.label(rc1_rc1_s1.id) : pad.label,
-  };
+  FeatureVector feature(kNFeatures);
+  extract(state, feature.data());
+  return feature;
 }
 
-std::vector<std::vector<FeatureVector>> Feature::unpackFeatures(
-    const std::vector<FeatureVector>& features) {
-  size_t batch_size = features.size();
-  int index = 0;
-
-  int end = kNWordFeatures;
-  std::vector<FeatureVector> word_features;
-  word_features.reserve(kNWordFeatures);
-  for (; index < end; ++index) {
-    FeatureVector feature_batch(batch_size);
-    for (unsigned i = 0; i < batch_size; ++i) {
-      feature_batch[i] = features[i][index];
-    }
-    word_features.push_back(std::move(feature_batch));
+void Feature::extract(const State& state, unsigned* out, size_t stride) {
+  const Token& pad = Token::createPad();
+  const SentenceView& sentence = state.sentence();
+  const int s0 = state.stack(0);
+  const int s1 = state.stack(1);
+  const int s2 = state.stack(2);
+  const int s3 = state.stack(3);
+  const int b0 = state.buffer(0);
+  const int b1 = state.buffer(1);
+  const int b2 = state.buffer(2);
+  const int b3 = state.buffer(3);
+
+  const int lc1_s0 = state.leftmost(s0);
+  const int rc1_s0 = state.rightmost(s0);
+  const int lc2_s0 = state.leftmost(s0, 2);
+  const int rc2_s0 = state.rightmost(s0, 2);
+  const int lc1_s1 = state.leftmost(s1);
+  const int rc1_s1 = state.rightmost(s1);
+  const int lc2_s1 = state.leftmost(s1, 2);
+  const int rc2_s1 = state.rightmost(s1, 2);
+
+  const int lc1_lc1_s0 = state.leftmost(lc1_s0);
+  const int rc1_rc1_s0 = state.rightmost(rc1_s0);
+  const int lc1_lc1_s1 = state.leftmost(lc1_s1);
+  const int rc1_rc1_s1 = state.rightmost(rc1_s1);
+
+  // every index is either -1 or a valid token index; the label features
+  // take the last kNLabelFeatures tokens, i.e. the children
+  const int tokens[kNWordFeatures] = {
+      s0, s1, s2, s3, b0, b1, b2, b3,
+      lc1_s0, rc1_s0, lc2_s0, rc2_s0, lc1_s1, rc1_s1, lc2_s1, rc2_s1,
+      lc1_lc1_s0, rc1_rc1_s0, lc1_lc1_s1, rc1_rc1_s1,
+  };
+  static_assert(kNWordFeatures == kNPosFeatures, "one tag per word");
+  static_assert(kNLabelFeatures <= kNWordFeatures, "labels of tokens");
+
+  // word features
+  for (int index : tokens) {
+    *out = index != -1 ? sentence.words[index] : pad.word;
+    out += stride;
+  }
+  // pos features
+  for (int index : tokens) {
+    *out = index != -1 ? sentence.tags[index] : pad.tag;
+    out += stride;
   }
-  end += kNPosFeatures;
-  std::vector<FeatureVector> pos_features;
-  pos_features.reserve(kNPosFeatures);
-  for (; index < end; ++index) {
-    FeatureVector feature_batch(batch_size);
-    for (unsigned i = 0; i < batch_size; ++i) {
-      feature_batch[i] = features[i][index];
-    }
-    pos_features.push_back(std::move(feature_batch));
+  // label features
+  for (unsigned i = kNWordFeatures - kNLabelFeatures; i < kNWordFeatures;
+       ++i) {
+    const int index = tokens[i];
+    *out = index != -1 ? static_cast<unsigned>(state.label(index)) : pad.label;
+    out += stride;
   }
-  end += kNLabelFeatures;
-  std::vector<FeatureVector> label_features;
-  label_features.reserve(kNLabelFeatures);
-  for (; index < end; ++index) {
-    FeatureVector feature_batch(batch_size);
-    for (unsigned i = 0; i < batch_size; ++i) {
-      feature_batch[i] = features[i][index];
-    }
-    label_features.push_back(std::move(feature_batch));
+}
+
+FeatureMatrix::FeatureMatrix() : batch_size_(0) {}
+
+FeatureMatrix::FeatureMatrix(const std::vector<FeatureVector>& features)
+    : FeatureMatrix() {
+  resize(features.size());
+  for (size_t i = 0; i < features.size(); ++i) {
+    set(i, features[i]);
+  }
+}
+
+void FeatureMatrix::resize(size_t batch_size) {
+  batch_size_ = batch_size;
+  ids_.resize(batch_size * Feature::kNFeatures);
+}
+
+void FeatureMatrix::set(size_t index, const State& state) {
+  Feature::extract(state, ids_.data() + index, batch_size_);
+}
+
+void FeatureMatrix::set(size_t index, const FeatureVector& feature) {
+  TRANSITIONPARSER_ASSERT(feature.size() == Feature::kNFeatures,
+                          "feature size must be " << Feature::kNFeatures);
+  set(index, feature.data());
+}
+
+FeatureVector FeatureMatrix::row(size_t index) const {
+  FeatureVector feature(Feature::kNFeatures);
+  for (unsigned j = 0; j < Feature::kNFeatures; ++j) {
+    feature[j] = (*this)(index, j);
   }
-  return {word_features, pos_features, label_features};
+  return feature;
 }
 
 }  // namespace transitionparser
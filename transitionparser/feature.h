@@ -19,13 +19,18 @@ typedef std::vector<unsigned> FeatureVector;
 
 class Feature {
  public:
-  static const unsigned kNWordFeatures;
-  static const unsigned kNPosFeatures;
-  static const unsigned kNLabelFeatures;
+  static constexpr unsigned kNWordFeatures = 20;
+  static constexpr unsigned kNPosFeatures = 20;
+  static constexpr unsigned kNLabelFeatures = 12;
+  static constexpr unsigned kNFeatures =
+      kNWordFeatures + kNPosFeatures + kNLabelFeatures;
 
   static FeatureVector extract(const State &state);
-  static std::vector<std::vector<FeatureVector>> unpackFeatures(
-      const std::vector<FeatureVector>& features);
+
+  // Writes the kNFeatures ids of the state to out[0], out[stride], ...,
+  // without allocating. A stride of 1 fills one row of a row-major batch
+  // and a stride of the batch size fills one column of a slot-major batch.
+  static void extract(const State& state, unsigned* out, size_t stride = 1);
 
  private:
   Feature() = delete;
@@ -33,6 +38,53 @@ class Feature {
   ~Feature() = delete;
 };
 
+// The features of a batch in one contiguous slot-major buffer: the ids of
+// slot j for the whole batch are at slot(j)[0], ..., slot(j)[batchSize() - 1].
+// This is the layout consumed by the embedding lookups, so a batch is built
+// once per step and never transposed. Resizing keeps the capacity.
+class FeatureMatrix {
+ public:
+  FeatureMatrix();
+  explicit FeatureMatrix(const std::vector<FeatureVector>& features);
+  DEFAULT_COPY_AND_MOVE(FeatureMatrix);
+  ~FeatureMatrix() {}
+
+  // Changes the batch size; the contents are unspecified afterwards.
+  void resize(size_t batch_size);
+
+  void set(size_t index, const State& state);
+
+  void set(size_t index, const FeatureVector& feature);
+
+  // Copies kNFeatures ids of any integral type, e.g. from a binary file.
+  template <typename T>
+  void set(size_t index, const T* feature) {
+    unsigned* out = ids_.data() + index;
+    for (unsigned j = 0; j < Feature::kNFeatures; ++j) {
+      *out = feature[j];
+      out += batch_size_;
+    }
+  }
+
+  FeatureVector row(size_t index) const;
+
+  size_t batchSize() const {
+    return batch_size_;
+  }
+
+  const unsigned* slot(unsigned j) const {
+    return ids_.data() + j * batch_size_;
+  }
+
+  unsigned operator()(size_t index, unsigned j) const {
+    return ids_[j * batch_size_ + index];
+  }
+
+ private:
+  size_t batch_size_;
+  std::vector<unsigned> ids_;
+};
+
 }  // namespace transitionparser
 
 #endif  // TRANSITIONPARSER_FEATURE_H_
@@ -124,6 +124,23 @@ class AppLogger : public Logger {
     sinks().push_back(std::move(stdout_color_st));
   }
 
+  // Logs to the standard error only, for commands whose results are written
+  // to the standard output.
+  static void initStderr(log::LogLevel display_level = log::LogLevel::info) {
+    if (sinks(false).size() > 0) {
+      getInstance().warn("AppLogger has already been initialized.");
+      return;
+    }
+    auto stderr_color_st =
+#ifdef _WIN32
+        std::make_shared<spdlog::sinks::wincolor_stderr_sink_st>();
+#else
+        std::make_shared<spdlog::sinks::ansicolor_stderr_sink_st>();
+#endif
+    stderr_color_st->set_level(display_level);
+    sinks().push_back(std::move(stderr_color_st));
+  }
+
  protected:
   static std::vector<spdlog::sink_ptr>& sinks(bool init = false) {
     static std::vector<spdlog::sink_ptr> sinks_;
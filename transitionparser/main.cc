@@ -6,46 +6,127 @@
 #include <boost/program_options.hpp>
 #include <dynet/dynet.h>
 #include <dynet/expr.h>
-#include <dynet/io.h>
 #include <dynet/tensor.h>
+#include <dynet/training.h>
+#include <pthread.h>
+#include <signal.h>
 
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <deque>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <numeric>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "transitionparser/allreduce.h"
 #include "transitionparser/classifier.h"
+#include "transitionparser/dataset.h"
 #include "transitionparser/logger.h"
+#include "transitionparser/model_bundle.h"
+#include "transitionparser/native_classifier.h"
+#include "transitionparser/optimizer.h"
 #include "transitionparser/parser.h"
+#include "transitionparser/prefetcher.h"
+#include "transitionparser/server.h"
+#include "transitionparser/shared_parameters.h"
 #include "transitionparser/tools.h"
 
 namespace transitionparser {
 
+// The settings of App::train, as given on the command line.
+struct TrainOptions {
+  std::string train_file;
+  std::string test_file;
+  std::string out_dir;
+  int num_epochs = 10;
+  int batch_size = 32;
+  // frequent words whose hidden layer products are cached for evaluation
+  unsigned precompute_size = 0;
+  bool quantize = false;
+  // beam widths to evaluate after training
+  std::vector<unsigned> beam_widths;
+  unsigned parse_threads = 1;
+  std::string cache_file;
+  // replays the gold actions instead of materializing the examples
+  bool replay = false;
+  unsigned prefetch_threads = 0;
+  // Hogwild worker processes
+  unsigned train_threads = 1;
+  // data-parallel replicas
+  unsigned num_replicas = 1;
+  std::string optimizer_name = "sgd";
+  bool save = false;
+};
+
 class App {
  public:
   App() {}
 
-  void train(const std::string& train_file,
-             const std::string& test_file,
-             const std::string& out_dir,
-             const int num_epochs,
-             const int batch_size,
-             const bool save=false) {
+  // bytes of parsed CoNLL collected before each write
+  static const size_t kOutputBufferSize = 1 << 16;
+
+  void train(const TrainOptions& options) {
     log::info("Hello, World!");
+    TRANSITIONPARSER_ASSERT(
+        options.train_threads <= 1 || options.num_replicas <= 1,
+        "Hogwild and data-parallel training exclude each other");
+    // the state of adagrad and adam would live in the forked workers and be
+    // lost after every epoch
+    TRANSITIONPARSER_ASSERT(
+        options.train_threads <= 1 || options.optimizer_name == "sgd",
+        "Hogwild training supports the sgd optimizer only");
+    // the cache holds the features themselves, so there is nothing to replay
+    TRANSITIONPARSER_ASSERT(
+        options.cache_file.empty() || !options.replay,
+        "--cache and --replay exclude each other");
 
-    const std::vector<Sentence> train_sentences = tools::read_conll(train_file);
-    log::info("train sentence size: {} from '{}'",
-              train_sentences.size(), train_file);
-    Token::fixDictionaries();
+    // the examples and the dictionaries come from the cache when it was
+    // written from the train file as it is now, otherwise they are built
+    // from the train file and cached if requested
+    Corpus train_corpus;
+    std::unique_ptr<ExampleSource> examples;
+    if (!options.cache_file.empty() &&
+        MappedExamples::isUpToDate(options.cache_file, options.train_file)) {
+      auto mapped = std::make_unique<MappedExamples>(options.cache_file);
+      mapped->loadDictionaries();
+      examples = std::move(mapped);
+      log::info("train examples: {} from '{}'",
+                examples->size(), options.cache_file);
+    } else {
+      if (!options.cache_file.empty() &&
+          std::ifstream(options.cache_file).good()) {
+        log::info("'{}' is out of date and is rebuilt from '{}'",
+                  options.cache_file, options.train_file);
+      }
+      train_corpus = tools::read_conll_corpus(options.train_file);
+      log::info("train sentence size: {} from '{}'",
+                train_corpus.size(), options.train_file);
+      Token::fixDictionaries();
+      if (!options.cache_file.empty()) {
+        MappedExamples::write(options.cache_file, train_corpus,
+                              options.train_file);
+        examples = std::make_unique<MappedExamples>(options.cache_file);
+        log::info("train examples: {} cached to '{}'",
+                  examples->size(), options.cache_file);
+      } else if (options.replay) {
+        examples = std::make_unique<ReplayExamples>(train_corpus);
+      } else {
+        examples = std::make_unique<InMemoryExamples>(train_corpus);
+      }
+    }
 
-    const std::vector<Sentence> test_sentences = tools::read_conll(test_file);
+    const std::vector<Sentence> test_sentences =
+        tools::read_conll(options.test_file);
     log::info("test sentence size: {} from '{}'",
-              test_sentences.size(), test_file);
+              test_sentences.size(), options.test_file);
 
     dynet::ParameterCollection model;
-    auto optimizer = dynet::SimpleSGDTrainer(model);
 
-    std::shared_ptr<NeuralClassifier> classifier
+    std::shared_ptr<MlpClassifier> classifier
         = std::make_shared<MlpClassifier>(
             model,
             Token::getDict(Token::FORM).size(),
@@ -61,91 +142,484 @@ class App {
             256,
             Transition::numActions(Token::getDict(Token::DEPREL).size() - 2));
 
-    GreedyParser parser(classifier);
+    // the DyNet trainer updates the dense parameters, and for adagrad and
+    // adam the sparse optimizer of the same kind the rows of the embedding
+    // tables. Plain sgd leaves all of them to the trainer, which updates only
+    // the rows looked up and clips the gradients as a whole.
+    std::unique_ptr<dynet::Trainer> optimizer;
+    if (options.optimizer_name == "adagrad") {
+      optimizer = std::make_unique<dynet::AdagradTrainer>(model);
+    } else if (options.optimizer_name == "adam") {
+      optimizer = std::make_unique<dynet::AdamTrainer>(model);
+    } else if (options.optimizer_name == "sgd") {
+      optimizer = std::make_unique<dynet::SimpleSGDTrainer>(model);
+    } else {
+      TRANSITIONPARSER_EXCEPTION("unknown optimizer '{}'.",
+                                 options.optimizer_name);
+    }
+    std::unique_ptr<SparseOptimizer> sparse_optimizer;
+    if (options.optimizer_name == "adagrad" ||
+        options.optimizer_name == "adam") {
+      sparse_optimizer = SparseOptimizer::create(options.optimizer_name);
+      for (const auto& p : model.lookup_parameters_list()) {
+        sparse_optimizer->addTable(p->values.size(), p->dim.size());
+      }
+    }
 
-    std::vector<FeatureVector> X;
-    std::vector<unsigned> Y;
+    // evaluation runs on a DyNet-free copy of the weights
+    auto native_classifier = std::make_shared<NativeMlpClassifier>(*classifier);
+    GreedyParser parser(native_classifier, options.parse_threads);
 
-    for (auto& sentence : train_sentences) {
-      State state(sentence);
-      while (!Transition::isTerminal(state)) {
-        Action action = Transition::getOracle(state);
-        Y.push_back(static_cast<unsigned>(action));
-        X.push_back(Feature::extract(state));
-        Transition::apply(action, &state);
-      }
+    if (options.precompute_size > 0) {
+      native_classifier->precompute(
+          tools::frequent_words(*examples, options.precompute_size));
+    }
+
+    // the Hogwild workers update one shared copy of the weights, each with
+    // the gradients of its own batches only
+    std::unique_ptr<SharedParameters> shared_parameters;
+    if (options.train_threads > 1) {
+      shared_parameters = std::make_unique<SharedParameters>(&model);
     }
 
     int epoch = 0;
-    size_t sample_size = X.size();
-    size_t num_batches = sample_size / batch_size + 1;
+    const size_t sample_size = examples->size();
+    tools::BatchIndices batches(sample_size, options.batch_size);
+    std::unique_ptr<SharedAllReduce> allreduce;
+    if (options.num_replicas > 1) {
+      allreduce = std::make_unique<SharedAllReduce>(
+          options.num_replicas,
+          gradientCapacity(model, options.num_replicas * options.batch_size));
+    }
 
-    while (epoch < num_epochs) {
+    while (epoch < options.num_epochs) {
       log::info("iteration {}", epoch + 1);
-      double loss = 0;
-      double correct = 0;
-
-      int batch_index = 0;
-      for (auto& batch : tools::create_batch(X, Y, batch_size, true)) {
-        ++batch_index;
-        if (batch_index % (num_batches / 10) == 0) {
-          log::info("process batch {} of {}", ++batch_index, num_batches);
+      if (epoch > 0) batches.shuffle();
+      auto start = utility::date::now();
+      EpochStats stats = {0.0, 0.0};
+      if (options.num_replicas > 1) {
+        // synchronous data parallelism: the replicas are forked with the
+        // same parameters, take every n-th batch and apply the same averaged
+        // gradients, so they stay identical. Replica 0 is this process and
+        // keeps the parameters after the epoch.
+        auto results = utility::process::fork_join_here<EpochStats>(
+            options.num_replicas, [&](unsigned k) {
+              try {
+                return trainBatches(classifier.get(), &model, optimizer.get(),
+                                    sparse_optimizer.get(), *examples,
+                                    batches, k, options.num_replicas,
+                                    options.prefetch_threads, allreduce.get());
+              } catch (...) {
+                allreduce->abort();
+                throw;
+              }
+            });
+        for (const auto& result : results) {
+          stats.loss += result.loss;
+          stats.correct += result.correct;
         }
-        auto& x = batch.first;
-        auto& t = batch.second;
-        size_t current_batch_size = x.size();
-
-        dynet::ComputationGraph cg;
-        classifier->prepare(&cg);
-
-        auto y = classifier->run(x);
-        auto pred_actions = dynet::as_vector(dynet::TensorTools::argmax(
-            cg.incremental_forward(dynet::softmax(y))));
-        for (unsigned index = 0; index < current_batch_size; ++index) {
-          if (pred_actions[index] == t[index]) ++correct;
+      } else if (options.train_threads > 1) {
+        // Hogwild (Niu et al., 2011): the workers take every n-th batch and
+        // update the weights, which live in shared memory, without locks.
+        // The gradients stay private to each worker.
+        auto results = utility::process::fork_join<EpochStats>(
+            options.train_threads, [&](unsigned k) {
+              return trainBatches(classifier.get(), &model, optimizer.get(),
+                                  sparse_optimizer.get(), *examples,
+                                  batches, k, options.train_threads,
+                                  options.prefetch_threads);
+            });
+        for (const auto& result : results) {
+          stats.loss += result.loss;
+          stats.correct += result.correct;
         }
-        auto loss_expr = dynet::sum_batches(
-            dynet::pickneglogsoftmax(y, t)) / current_batch_size;
-        loss += dynet::as_scalar(cg.incremental_forward(loss_expr));
-        cg.backward(loss_expr);
-        optimizer.update();
+      } else {
+        stats = trainBatches(classifier.get(), &model, optimizer.get(),
+                             sparse_optimizer.get(), *examples, batches, 0, 1,
+                             options.prefetch_threads);
       }
+      double elapsed = std::chrono::duration<double>(
+          utility::date::now() - start).count();
 
-      log::info("loss {}", loss);
-      log::info("accuracy {}", correct / sample_size);
+      log::info("loss {}", stats.loss);
+      log::info("accuracy {}", stats.correct / sample_size);
+      log::info("{:.1f} examples/sec with {} workers",
+                sample_size / elapsed,
+                std::max({options.train_threads, options.num_replicas, 1u}));
       ++epoch;
 
-      float count = 0;
-      float uas = 0;
-      float las = 0;
+      native_classifier->load(*classifier);
+      auto score = evaluate(&parser, test_sentences, options.batch_size);
+      log::info("UAS: {:.4f}, LAS: {:.4f}", score.first, score.second);
+    }
+
+    if (options.quantize) {
+      GreedyParser quantized_parser(
+          std::make_shared<QuantizedMlpClassifier>(*classifier),
+          options.parse_threads);
+      auto float_score = evaluate(&parser, test_sentences, options.batch_size);
+      auto int8_score = evaluate(&quantized_parser, test_sentences,
+                                 options.batch_size);
+      log::info("int8 UAS: {:.4f} ({:+.4f}), LAS: {:.4f} ({:+.4f})",
+                int8_score.first, int8_score.first - float_score.first,
+                int8_score.second, int8_score.second - float_score.second);
+    }
+
+    for (unsigned beam_width : options.beam_widths) {
+      BeamParser beam_parser(native_classifier, beam_width);
+      auto start = utility::date::now();
+      auto score = evaluate(&beam_parser, test_sentences, options.batch_size);
+      double elapsed = std::chrono::duration<double>(
+          utility::date::now() - start).count();
+      log::info("beam {:2d}: UAS: {:.4f}, LAS: {:.4f}, {:.1f} sentences/sec",
+                beam_width, score.first, score.second,
+                test_sentences.size() / elapsed);
+    }
+
+    if (options.save) {
+      // the native copy holds the weights of the last epoch
+      const std::string date = utility::date::strftime("%Y%m%d");
+      const std::string model_file =
+          utility::string::format("{}/{}.model", options.out_dir, date);
+      native_classifier->save(model_file);
+      log::info("saved the model to '{}'", model_file);
+    }
+  }
+
+  // Parses the CoNLL sentences of `input_file`, or of the standard input
+  // when it is "-", with a saved model and writes them to `output_file`, or
+  // the standard output, with the predicted HEAD and DEPREL columns. The
+  // input is parsed in windows of `window_size` sentences and the
+  // dictionaries of the model are fixed, so the memory stays bounded
+  // whatever the size of the input.
+  void parse(const std::string& model_file,
+             const std::string& input_file,
+             const std::string& output_file,
+             const int batch_size,
+             const size_t window_size,
+             const unsigned parse_threads = 1,
+             const bool quantize = false,
+             const bool continuous = false,
+             const bool pipelined = false) {
+    GreedyParser parser(loadClassifier(model_file, quantize), parse_threads,
+                        continuous, pipelined);
+
+    std::ios::sync_with_stdio(false);
+    std::ifstream ifs;
+    if (input_file != "-") {
+      ifs.open(input_file);
+      if (!ifs) {
+        TRANSITIONPARSER_EXCEPTION("cannot open '{}'.", input_file);
+      }
+    }
+    std::ofstream ofs;
+    if (output_file != "-") {
+      ofs.open(output_file, std::ios::binary | std::ios::trunc);
+      if (!ofs) {
+        TRANSITIONPARSER_EXCEPTION("cannot open '{}'.", output_file);
+      }
+    }
+    std::istream& is = input_file != "-" ? ifs : std::cin;
+    std::ostream& os = output_file != "-" ? ofs : std::cout;
+
+    tools::ConllChunkReader reader(is);
+    // the token lines of the sentences of the window, in input order
+    std::deque<std::vector<std::string>> lines;
+    std::string buffer;
+    size_t num_sentences = 0;
+    size_t num_tokens = 0;
+    auto start = utility::date::now();
+    parser.parse_stream(
+        [&](std::vector<Sentence>* window) {
+          lines.emplace_back();
+          if (reader.next(window, &lines.back())) return true;
+          lines.pop_back();
+          return false;
+        },
+        window_size, batch_size,
+        [&](const State& state) {
+          tools::write_conll(state, lines.front().data(), &buffer);
+          num_tokens += lines.front().size();
+          ++num_sentences;
+          lines.pop_front();
+          if (buffer.size() >= kOutputBufferSize) {
+            os.write(buffer.data(), buffer.size());
+            buffer.clear();
+          }
+        });
+    os.write(buffer.data(), buffer.size());
+    os.flush();
+    if (!os) {
+      TRANSITIONPARSER_EXCEPTION("failed to write '{}'.", output_file);
+    }
+    double elapsed = std::chrono::duration<double>(
+        utility::date::now() - start).count();
+    log::info("parsed {} sentences, {} tokens in {:.2f} sec", num_sentences,
+              num_tokens, elapsed);
+    log::info("{:.1f} sentences/sec, {:.1f} tokens/sec",
+              num_sentences / elapsed, num_tokens / elapsed);
+  }
+
+  // Serves a saved model on a Unix domain socket until SIGINT or SIGTERM.
+  // The sentences of all connections are parsed in shared batches of up to
+  // `max_batch_size` states; an idle parser waits up to `max_wait` for a
+  // batch to fill.
+  void serve(const std::string& model_file,
+             const std::string& socket_path,
+             const size_t max_batch_size,
+             const std::chrono::microseconds max_wait,
+             const bool quantize = false) {
+    // the signals are taken by sigwait, so every thread must block them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    ParseServer server(loadClassifier(model_file, quantize), socket_path,
+                       max_batch_size, max_wait);
+    log::info("listening on '{}'", socket_path);
+    int signal;
+    sigwait(&signals, &signal);
+    log::info("stopping on signal {}; {:.1f} states per batch on average",
+              signal, server.meanBatchSize());
+  }
+
+  // Sends the sentences of `input_file` in turn to a server from
+  // `num_clients` concurrent clients and reports the latency.
+  void loadgen(const std::string& socket_path,
+               const std::string& input_file,
+               const unsigned num_clients,
+               const size_t num_requests) {
+    std::ifstream ifs(input_file);
+    if (!ifs) {
+      TRANSITIONPARSER_EXCEPTION("cannot open '{}'.", input_file);
+    }
+    std::vector<std::string> sentences(1);
+    std::string line;
+    while (std::getline(ifs, line)) {
+      utility::string::trim(line);
+      if (!line.empty()) {
+        sentences.back() += line + "\n";
+      } else if (!sentences.back().empty()) {
+        sentences.emplace_back();
+      }
+    }
+    if (sentences.back().empty()) sentences.pop_back();
+    log::info("sending {} requests from {} clients, {} distinct sentences",
+              num_requests, num_clients, sentences.size());
+    LoadReport report = generate_load(socket_path, sentences, num_clients,
+                                      num_requests);
+    log::info("{:.1f} sentences/sec, p50 {:.2f} ms, p99 {:.2f} ms",
+              report.num_requests / report.seconds, report.p50_ms,
+              report.p99_ms);
+  }
+
+  // Loads a model saved by `train --save` with its dictionaries.
+  std::shared_ptr<Classifier> loadClassifier(const std::string& model_file,
+                                             const bool quantize) {
+    auto bundle = std::make_shared<const ModelBundle>(model_file);
+    bundle->loadDictionaries();
+    std::shared_ptr<Classifier> classifier;
+    if (quantize) {
+      classifier = std::make_shared<QuantizedMlpClassifier>(bundle);
+    } else {
+      classifier = std::make_shared<NativeMlpClassifier>(bundle);
+    }
+    log::info("loaded the model from '{}'", model_file);
+    return classifier;
+  }
+
+  struct EpochStats {
+    double loss;
+    double correct;
+  };
+
+  // Trains the classifier on the batches `first`, `first + step`, ... of an
+  // epoch, one optimizer update per batch. With `allreduce`, the gradients
+  // are averaged with the other replicas before each update; `first` is the
+  // rank of this replica and `step` the number of replicas.
+  EpochStats trainBatches(MlpClassifier* classifier,
+                          dynet::ParameterCollection* model,
+                          dynet::Trainer* optimizer,
+                          SparseOptimizer* sparse_optimizer,
+                          const ExampleSource& examples,
+                          const tools::BatchIndices& batches,
+                          const size_t first,
+                          const size_t step,
+                          const unsigned prefetch_threads,
+                          SharedAllReduce* allreduce = nullptr) {
+    EpochStats stats = {0.0, 0.0};
+    // the workers stay at most two batches each ahead of the trainer
+    BatchPrefetcher prefetcher(examples, prefetch_threads,
+                               std::max(2u, 2 * prefetch_threads));
+    prefetcher.start(batches, first, step);
+    const size_t num_batches = prefetcher.size();
+    // every replica takes part in as many reductions as the first one, with
+    // an empty batch once its own batches have run out
+    const size_t num_steps = allreduce != nullptr
+        ? (batches.size() + step - 1) / step : num_batches;
+    for (size_t batch_index = 0; batch_index < num_steps; ++batch_index) {
+      if (first == 0
+          && (batch_index + 1) % std::max<size_t>(num_steps / 10, 1) == 0) {
+        log::info("process batch {} of {}", batch_index + 1, num_steps);
+      }
+      if (batch_index >= num_batches) {
+        averageGradients(model, allreduce, first, 0);
+        update(model, optimizer, sparse_optimizer);
+        continue;
+      }
+      const BatchPrefetcher::Batch& batch = prefetcher.next();
+      const FeatureMatrix& x = batch.features;
+      const std::vector<unsigned>& t = batch.actions;
+      const size_t current_batch_size = t.size();
+
       dynet::ComputationGraph cg;
       classifier->prepare(&cg);
-      auto states = parser.parse_batch(test_sentences, batch_size);
-      for (auto& state : states) {
-        for (int i = 1; i < state->numTokens(); ++i) {
-          ++count;
-          if (state->head(i) == state->getToken(i).head) {
-            uas += 1;
-            if (state->label(i)
-                == static_cast<int>(state->getToken(i).label)) {
-              las += 1;
-            }
-          }
+
+      auto y = classifier->run(x);
+      auto pred_actions = dynet::as_vector(dynet::TensorTools::argmax(
+          cg.incremental_forward(dynet::softmax(y))));
+      for (unsigned index = 0; index < current_batch_size; ++index) {
+        if (pred_actions[index] == t[index]) ++stats.correct;
+      }
+      auto loss_expr = dynet::sum_batches(
+          dynet::pickneglogsoftmax(y, t)) / current_batch_size;
+      stats.loss += dynet::as_scalar(cg.incremental_forward(loss_expr));
+      cg.backward(loss_expr);
+      if (allreduce != nullptr) {
+        averageGradients(model, allreduce, first, current_batch_size);
+      }
+      update(model, optimizer, sparse_optimizer);
+    }
+    return stats;
+  }
+
+  // Updates the rows of the embedding tables that have a gradient with the
+  // sparse optimizer, if any, and clears their gradients, so that the DyNet
+  // trainer only updates the dense parameters. Gradient clipping of the
+  // trainer then no longer sees the embedding gradients; without a sparse
+  // optimizer the trainer updates and clips everything.
+  void update(dynet::ParameterCollection* model,
+              dynet::Trainer* optimizer,
+              SparseOptimizer* sparse_optimizer) {
+    if (sparse_optimizer == nullptr) {
+      optimizer->update();
+      return;
+    }
+    sparse_optimizer->step();
+    const auto& lookups = model->lookup_parameters_list();
+    std::vector<unsigned> rows;
+    for (unsigned table = 0; table < lookups.size(); ++table) {
+      dynet::LookupParameterStorage& p = *lookups[table];
+      if (p.all_updated) {
+        rows.resize(p.values.size());
+        std::iota(rows.begin(), rows.end(), 0);
+      } else {
+        rows.assign(p.non_zero_grads.begin(), p.non_zero_grads.end());
+      }
+      sparse_optimizer->update(table, p.all_values.v, p.all_grads.v, rows);
+      p.clear();
+    }
+    optimizer->update();
+  }
+
+  // Replaces the gradients of every replica with their mean over the
+  // examples of all replicas, weighting each replica by its batch size.
+  // Only the embedding rows looked up by some replica are exchanged, and
+  // all of them are marked for the sparse update.
+  void averageGradients(dynet::ParameterCollection* model,
+                        SharedAllReduce* allreduce,
+                        const unsigned rank,
+                        const size_t batch_size) {
+    const auto& lookups = model->lookup_parameters_list();
+    // the rows of all tables are numbered one after another
+    std::vector<unsigned> rows;
+    unsigned offset = 0;
+    for (const auto& p : lookups) {
+      if (p->all_updated) {
+        for (unsigned row = 0; row < p->values.size(); ++row) {
+          rows.push_back(offset + row);
         }
+      } else {
+        for (unsigned row : p->non_zero_grads) {
+          rows.push_back(offset + row);
+        }
+      }
+      offset += p->values.size();
+    }
+    rows = allreduce->unite(rank, rows);
+
+    std::vector<SharedAllReduce::Span> spans;
+    for (const auto& p : model->parameters_list()) {
+      spans.emplace_back(p->g.v, p->g.d.size());
+    }
+    offset = 0;
+    auto row = rows.begin();
+    for (const auto& p : lookups) {
+      const unsigned end = offset + p->values.size();
+      p->non_zero_grads.clear();
+      for (; row != rows.end() && *row < end; ++row) {
+        dynet::Tensor& g = p->grads[*row - offset];
+        spans.emplace_back(g.v, g.d.size());
+        p->non_zero_grads.insert(*row - offset);
       }
-      log::info("UAS: {:.4f}, LAS: {:.4f}",
-                (uas / count) * 100,
-                (las / count) * 100);
+      offset = end;
+    }
+    // the losses are means over the batch
+    for (const auto& span : spans) {
+      for (size_t i = 0; i < span.second; ++i) span.first[i] *= batch_size;
     }
+    float count = batch_size;
+    spans.emplace_back(&count, 1);
+    allreduce->sum(rank, spans);
+    spans.pop_back();
+    for (const auto& span : spans) {
+      for (size_t i = 0; i < span.second; ++i) span.first[i] /= count;
+    }
+  }
+
+  // Returns the number of values a replica contributes to a reduction at
+  // most: every dense gradient and the embedding rows that `batch_size`
+  // examples of all replicas can look up.
+  static size_t gradientCapacity(const dynet::ParameterCollection& model,
+                                 const size_t batch_size) {
+    size_t capacity = 1;
+    size_t num_rows = 0;
+    for (const auto& p : model.parameters_list()) {
+      capacity += p->g.d.size();
+    }
+    for (const auto& p : model.lookup_parameters_list()) {
+      const size_t rows = std::min<size_t>(
+          p->values.size(), batch_size * Feature::kNFeatures);
+      capacity += rows * p->dim.size();
+      num_rows += p->values.size();
+    }
+    // the ids exchanged before the gradients
+    return std::max(capacity, num_rows + 1);
+  }
 
-    if (save) {
-      {
-        const std::string date = utility::date::strftime("%Y%m%d");
-        dynet::TextFileSaver saver(
-            utility::string::format("{}/{}.model", out_dir, date));
-        saver.save(model);
+  // Returns UAS and LAS in percent, excluding the root token.
+  std::pair<float, float> evaluate(Parser* parser,
+                                   const std::vector<Sentence>& sentences,
+                                   const int batch_size) {
+    float count = 0;
+    float uas = 0;
+    float las = 0;
+    auto states = parser->parse_batch(sentences, batch_size);
+    for (auto& state : states) {
+      const SentenceView& gold = state->sentence();
+      for (int i = 1; i < state->numTokens(); ++i) {
+        ++count;
+        if (state->head(i) == gold.heads[i]) {
+          uas += 1;
+          if (state->label(i) == static_cast<int>(gold.labels[i])) {
+            las += 1;
+          }
+        }
       }
     }
+    return {(uas / count) * 100, (las / count) * 100};
   }
 
   void initialize(unsigned random_seed = 0,
@@ -170,8 +644,134 @@ class App {
 namespace tp = transitionparser;
 namespace po = boost::program_options;
 
+// Parses CoNLL with a model saved by `train --save`:
+//     transitionparser parse --model <file> [--input <file>] [--output <file>]
+int parse(int argc, const char* argv[]) {
+  po::options_description option("parse option");
+  option.add_options()
+      ("help,h", "show help")
+      ("model", po::value<std::string>()->required(),
+       "model file written by train --save")
+      ("input", po::value<std::string>()->default_value("-"),
+       "CoNLL file to parse (- reads the standard input)")
+      ("output", po::value<std::string>()->default_value("-"),
+       "file to write the parsed CoNLL to (- writes the standard output)")
+      ("batchsize", po::value<int>()->default_value(32), "batch size")
+      ("chunksize", po::value<size_t>()->default_value(10000),
+       "number of sentences held in memory, within which they are sorted "
+       "by length for batching")
+      ("parsethreads", po::value<unsigned>()->default_value(1),
+       "number of threads parsing the batches of a chunk")
+      ("quantize", "parse with the int8 quantized model")
+      ("continuous", "refill the slot of each parsed sentence with the next "
+       "one instead of running fixed batches to the end")
+      ("pipelined", "extract the features of half a batch on a second "
+       "thread while the classifier scores the other half; cannot be used "
+       "with --continuous");
+
+  po::variables_map args;
+  po::store(po::parse_command_line(argc, argv, option), args);
+  if (args.count("help") > 0) {
+    std::cerr << option << std::endl;
+    return 0;
+  }
+  po::notify(args);
+
+  // the standard output may carry the parsed sentences
+  tp::AppLogger::initStderr(tp::log::LogLevel::info);
+  tp::App app;
+  app.parse(
+      args["model"].as<std::string>(),
+      args["input"].as<std::string>(),
+      args["output"].as<std::string>(),
+      args["batchsize"].as<int>(),
+      args["chunksize"].as<size_t>(),
+      args["parsethreads"].as<unsigned>(),
+      args.count("quantize") > 0,
+      args.count("continuous") > 0,
+      args.count("pipelined") > 0);
+  return 0;
+}
+
+// Serves a saved model on a Unix domain socket:
+//     transitionparser serve --model <file> --socket <path>
+int serve(int argc, const char* argv[]) {
+  po::options_description option("serve option");
+  option.add_options()
+      ("help,h", "show help")
+      ("model", po::value<std::string>()->required(),
+       "model file written by train --save")
+      ("socket", po::value<std::string>()->required(),
+       "path of the Unix domain socket to listen on")
+      ("maxbatch", po::value<size_t>()->default_value(64),
+       "maximum number of sentences parsed in one batch")
+      ("maxwait", po::value<unsigned>()->default_value(1000),
+       "microseconds an idle parser waits for a batch to fill")
+      ("quantize", "parse with the int8 quantized model");
+
+  po::variables_map args;
+  po::store(po::parse_command_line(argc, argv, option), args);
+  if (args.count("help") > 0) {
+    std::cerr << option << std::endl;
+    return 0;
+  }
+  po::notify(args);
+
+  tp::AppLogger::initStderr(tp::log::LogLevel::info);
+  tp::App app;
+  app.serve(
+      args["model"].as<std::string>(),
+      args["socket"].as<std::string>(),
+      args["maxbatch"].as<size_t>(),
+      std::chrono::microseconds(args["maxwait"].as<unsigned>()),
+      args.count("quantize") > 0);
+  return 0;
+}
+
+// Measures the latency of a running server:
+//     transitionparser loadgen --socket <path> --input <file>
+int loadgen(int argc, const char* argv[]) {
+  po::options_description option("loadgen option");
+  option.add_options()
+      ("help,h", "show help")
+      ("socket", po::value<std::string>()->required(),
+       "path of the Unix domain socket of the server")
+      ("input", po::value<std::string>()->required(),
+       "CoNLL file whose sentences are sent in turn")
+      ("clients", po::value<unsigned>()->default_value(16),
+       "number of concurrent clients, each waiting for its reply")
+      ("requests", po::value<size_t>()->default_value(10000),
+       "number of sentences sent in total");
+
+  po::variables_map args;
+  po::store(po::parse_command_line(argc, argv, option), args);
+  if (args.count("help") > 0) {
+    std::cerr << option << std::endl;
+    return 0;
+  }
+  po::notify(args);
+
+  tp::AppLogger::initStderr(tp::log::LogLevel::info);
+  tp::App app;
+  app.loadgen(
+      args["socket"].as<std::string>(),
+      args["input"].as<std::string>(),
+      args["clients"].as<unsigned>(),
+      args["requests"].as<size_t>());
+  return 0;
+}
+
 int main(int argc, const char* argv[]) {
   try {
+    if (argc > 1 && std::string(argv[1]) == "parse") {
+      return parse(argc - 1, argv + 1);
+    }
+    if (argc > 1 && std::string(argv[1]) == "serve") {
+      return serve(argc - 1, argv + 1);
+    }
+    if (argc > 1 && std::string(argv[1]) == "loadgen") {
+      return loadgen(argc - 1, argv + 1);
+    }
     po::options_description option("train option");
     option.add_options()
         ("help,h", "show help")
@@ -182,6 +782,37 @@ int main(int argc, const char* argv[]) {
         ("epoch", po::value<int>()->default_value(10),
          "number of training iteration")
         ("batchsize", po::value<int>()->default_value(32), "batch size")
+        ("precompute", po::value<unsigned>()->default_value(0),
+         "number of frequent words whose hidden layer products are cached "
+         "for evaluation (0 disables precomputation)")
+        ("quantize", "report UAS/LAS of the int8 quantized model")
+        ("beam", po::value<std::vector<unsigned>>()->multitoken(),
+         "beam widths to report UAS/LAS and speed for after training")
+        ("parsethreads", po::value<unsigned>()->default_value(1),
+         "number of threads used to parse the test file")
+        ("cache", po::value<std::string>()->default_value(""),
+         "binary file of the oracle examples and dictionaries of the train "
+         "file; read instead of the train file when it exists, written "
+         "otherwise")
+        ("replay", "keep only the gold actions of the train file and "
+         "regenerate the features of each batch, on the --prefetch threads "
+         "if any; cannot be used with --cache")
+        ("prefetch", po::value<unsigned>()->default_value(0),
+         "number of threads gathering the next train batches while the "
+         "current one is trained (0 gathers them on the training thread)")
+        ("threads", po::value<unsigned>()->default_value(1),
+         "number of worker processes training on disjoint batches with "
+         "private gradients and lock-free updates of shared weights "
+         "(Hogwild)")
+        ("replicas", po::value<unsigned>()->default_value(1),
+         "number of processes training replicas of the model on disjoint "
+         "batches and averaging their gradients before each update")
+        ("save", "write the trained model, with its dictionaries, to "
+         "<outdir>/<date>.model")
+        ("optimizer", po::value<std::string>()->default_value("sgd"),
+         "sgd, adagrad or adam; the embedding tables are updated lazily, "
+         "only in the rows looked up by the batch. Hogwild training "
+         "(--threads > 1) supports sgd only")
         ("memory", po::value<std::string>()->default_value("512,1024,512,512"),
          "allocating memory");
 
@@ -198,12 +829,26 @@ int main(int argc, const char* argv[]) {
         tp::log::LogLevel::info,
         tp::log::LogLevel::debug,
         args["outdir"].as<std::string>() + "/logs");
-    app.train(
-        args["trainfile"].as<std::string>(),
-        args["testfile"].as<std::string>(),
-        args["outdir"].as<std::string>(),
-        args["epoch"].as<int>(),
-        args["batchsize"].as<int>());
+    tp::TrainOptions options;
+    options.train_file = args["trainfile"].as<std::string>();
+    options.test_file = args["testfile"].as<std::string>();
+    options.out_dir = args["outdir"].as<std::string>();
+    options.num_epochs = args["epoch"].as<int>();
+    options.batch_size = args["batchsize"].as<int>();
+    options.precompute_size = args["precompute"].as<unsigned>();
+    options.quantize = args.count("quantize") > 0;
+    if (args.count("beam") > 0) {
+      options.beam_widths = args["beam"].as<std::vector<unsigned>>();
+    }
+    options.parse_threads = args["parsethreads"].as<unsigned>();
+    options.cache_file = args["cache"].as<std::string>();
+    options.replay = args.count("replay") > 0;
+    options.prefetch_threads = args["prefetch"].as<unsigned>();
+    options.train_threads = args["threads"].as<unsigned>();
+    options.num_replicas = args["replicas"].as<unsigned>();
+    options.optimizer_name = args["optimizer"].as<std::string>();
+    options.save = args.count("save") > 0;
+    app.train(options);
   } catch (std::exception &e) {
     std::cerr << e.what() << std::endl;
     exit(1);
@@ -0,0 +1,114 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include "transitionparser/model_bundle.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "transitionparser/logger.h"
+#include "transitionparser/token.h"
+
+namespace transitionparser {
+
+namespace {
+
+const size_t kAlignment = 64;
+
+uint64_t align(uint64_t offset) {
+  return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+}  // namespace
+
+const char ModelBundle::kMagic[8] = {'T', 'P', 'M', 'O', 'D', 'E', 'L', '\0'};
+const uint32_t ModelBundle::kVersion = 1;
+
+size_t ModelBundle::padded(const size_t size) {
+  const size_t floats = kAlignment / sizeof(float);
+  return (size + floats - 1) / floats * floats;
+}
+
+ModelBundle::ModelBundle(const std::string& filepath) {
+  if (!file_.open(filepath)) {
+    TRANSITIONPARSER_EXCEPTION("cannot open '{}'.", filepath);
+  }
+  if (file_.size() < sizeof(Header)) {
+    TRANSITIONPARSER_EXCEPTION("'{}' is not a model file.", filepath);
+  }
+  std::memcpy(&header_, file_.data(), sizeof(Header));
+  if (std::memcmp(header_.magic, kMagic, sizeof(kMagic)) != 0
+      || header_.version != kVersion) {
+    TRANSITIONPARSER_EXCEPTION("'{}' is not a model file of version {}.",
+                               filepath, kVersion);
+  }
+  if (header_.weights_offset % kAlignment != 0
+      || header_.weights_offset + header_.weights_size * sizeof(float)
+          > file_.size()
+      || header_.dict_offset + header_.dict_size > file_.size()) {
+    TRANSITIONPARSER_EXCEPTION("'{}' is truncated.", filepath);
+  }
+  // undoes the sequential hint of MappedFile: the embedding rows are read at
+  // random, but the dense layers are read whole on every step and still
+  // profit from the default readahead, which MADV_RANDOM would turn off
+  madvise(const_cast<char*>(file_.data()), file_.size(), MADV_NORMAL);
+}
+
+void ModelBundle::write(const std::string& filepath,
+                        const Architecture& architecture,
+                        const std::vector<Tensor>& tensors) {
+  std::ofstream ofs(filepath, std::ios::binary | std::ios::trunc);
+  if (!ofs) {
+    TRANSITIONPARSER_EXCEPTION("cannot open '{}'.", filepath);
+  }
+  std::ostringstream dicts;
+  Token::saveDictionaries(dicts);
+  const std::string dict = dicts.str();
+
+  Header header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.architecture = architecture;
+  header.dict_offset = sizeof(Header);
+  header.dict_size = dict.size();
+  header.weights_offset = align(header.dict_offset + header.dict_size);
+  for (const Tensor& tensor : tensors) {
+    header.weights_size += padded(tensor.second);
+  }
+
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  ofs.write(dict.data(), dict.size());
+  std::vector<char> padding(
+      header.weights_offset - header.dict_offset - header.dict_size, '\0');
+  ofs.write(padding.data(), padding.size());
+  for (const Tensor& tensor : tensors) {
+    ofs.write(reinterpret_cast<const char*>(tensor.first),
+              tensor.second * sizeof(float));
+    padding.assign((padded(tensor.second) - tensor.second) * sizeof(float),
+                   '\0');
+    ofs.write(padding.data(), padding.size());
+  }
+  if (!ofs) {
+    TRANSITIONPARSER_EXCEPTION("failed to write '{}'.", filepath);
+  }
+  LOG_DEBUG("wrote a model of {} floats to '{}'",
+            header.weights_size, filepath);
+}
+
+void ModelBundle::loadDictionaries() const {
+  std::istringstream iss(std::string(file_.data() + header_.dict_offset,
+                                     header_.dict_size));
+  Token::loadDictionaries(iss);
+}
+
+const float* ModelBundle::weights() const {
+  return reinterpret_cast<const float*>(file_.data()
+                                        + header_.weights_offset);
+}
+
+}  // namespace transitionparser
@@ -0,0 +1,93 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#ifndef TRANSITIONPARSER_MODEL_BUNDLE_H_
+#define TRANSITIONPARSER_MODEL_BUNDLE_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "transitionparser/utility.h"
+
+namespace transitionparser {
+
+// A trained model in one versioned binary file: the dictionaries, the
+// hyperparameters of the classifier and its weights. The file is
+// memory-mapped and the weights are read in place, so loading a model
+// neither parses text nor copies weights.
+//
+// Layout: a Header, the dictionaries as written by Token::saveDictionaries,
+// then from `weights_offset` the tensors one after another, each padded to
+// a multiple of 64 bytes so that every tensor is as aligned as the mapping.
+class ModelBundle {
+ public:
+  // The hyperparameters, in the order of the MlpClassifier constructor.
+  struct Architecture {
+    uint32_t word_vocab_size;
+    uint32_t word_embed_size;
+    uint32_t word_feature_size;
+    uint32_t pos_vocab_size;
+    uint32_t pos_embed_size;
+    uint32_t pos_feature_size;
+    uint32_t label_vocab_size;
+    uint32_t label_embed_size;
+    uint32_t label_feature_size;
+    uint32_t hidden1_size;
+    uint32_t hidden2_size;
+    uint32_t output_size;
+  };
+
+  typedef std::pair<const float*, size_t> Tensor;
+
+  // Returns `size` rounded up to the padding of a tensor, in floats.
+  static size_t padded(size_t size);
+
+  explicit ModelBundle(const std::string& filepath);
+
+  // Writes the tensors with the current Token dictionaries.
+  static void write(const std::string& filepath,
+                    const Architecture& architecture,
+                    const std::vector<Tensor>& tensors);
+
+  // Replaces the Token dictionaries with the ones stored in the file.
+  void loadDictionaries() const;
+
+  const Architecture& architecture() const {
+    return header_.architecture;
+  }
+
+  // Returns the padded tensors, `weightsSize()` floats in total.
+  const float* weights() const;
+
+  size_t weightsSize() const {
+    return header_.weights_size;
+  }
+
+ private:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    Architecture architecture;
+    uint64_t dict_offset;
+    uint64_t dict_size;
+    uint64_t weights_offset;
+    uint64_t weights_size;
+  };
+
+  static const char kMagic[8];
+  static const uint32_t kVersion;
+
+  utility::file::MappedFile file_;
+  Header header_;
+
+  DISALLOW_COPY_AND_MOVE(ModelBundle);
+};
+
+}  // namespace transitionparser
+
+#endif  // TRANSITIONPARSER_MODEL_BUNDLE_H_
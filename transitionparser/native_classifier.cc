@@ -0,0 +1,485 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include "transitionparser/native_classifier.h"
+
+#include <dynet/tensor.h>
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "transitionparser/logger.h"
+
+namespace transitionparser {
+
+namespace {
+
+typedef Eigen::Map<const Eigen::MatrixXf> ConstMatrixMap;
+typedef Eigen::Map<const Eigen::VectorXf> ConstVectorMap;
+typedef Eigen::Map<Eigen::MatrixXf> MatrixMap;
+typedef Eigen::Map<Eigen::VectorXf> VectorMap;
+
+// Each matrix starts on a 64-byte boundary relative to the buffer, the
+// same padding as in a model bundle.
+size_t aligned(size_t size) {
+  return ModelBundle::padded(size);
+}
+
+// Scratch buffers for the activations, and for the one row of a single
+// sample, reused across calls on a thread.
+struct Workspace {
+  FeatureMatrix single;
+  std::vector<float> h0;
+  std::vector<float> h1;
+  std::vector<float> h2;
+  std::vector<int8_t> quantized;
+};
+
+Workspace& workspace() {
+  static thread_local Workspace workspace;
+  return workspace;
+}
+
+template <typename T>
+T* reserve(std::vector<T>* buffer, size_t size) {
+  if (buffer->size() < size) buffer->resize(size);
+  return buffer->data();
+}
+
+// Quantizes a column-major float matrix into row-major int8 with one
+// symmetric scale per row.
+void quantize_rows(const float* matrix, size_t rows, size_t cols,
+                   std::vector<int8_t>* quantized,
+                   std::vector<float>* scales) {
+  ConstMatrixMap m(matrix, rows, cols);
+  quantized->resize(rows * cols);
+  scales->resize(rows);
+  for (size_t r = 0; r < rows; ++r) {
+    float max_abs = m.row(r).cwiseAbs().maxCoeff();
+    float scale = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+    (*scales)[r] = scale;
+    int8_t* row = quantized->data() + r * cols;
+    for (size_t c = 0; c < cols; ++c) {
+      row[c] = static_cast<int8_t>(std::lrint(m(r, c) / scale));
+    }
+  }
+}
+
+// Quantizes a vector symmetrically and returns its scale.
+float quantize_vector(const float* x, size_t size, int8_t* quantized) {
+  float max_abs = 0.0f;
+  for (size_t i = 0; i < size; ++i) {
+    max_abs = std::max(max_abs, std::abs(x[i]));
+  }
+  float scale = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+  float inverse = 1.0f / scale;
+  for (size_t i = 0; i < size; ++i) {
+    quantized[i] = static_cast<int8_t>(std::lrint(x[i] * inverse));
+  }
+  return scale;
+}
+
+// y = relu((W * x) * scales * x_scale + bias) with int32 accumulation.
+void gemv_relu(const int8_t* W, const float* scales, size_t rows, size_t cols,
+               const int8_t* x, float x_scale, const float* bias, float* y) {
+  for (size_t r = 0; r < rows; ++r) {
+    const int8_t* row = W + r * cols;
+    int32_t acc = 0;
+    for (size_t c = 0; c < cols; ++c) {
+      acc += static_cast<int32_t>(row[c]) * static_cast<int32_t>(x[c]);
+    }
+    y[r] = std::max(0.0f, acc * scales[r] * x_scale + bias[r]);
+  }
+}
+
+}  // namespace
+
+NativeMlpClassifier::NativeMlpClassifier(const MlpClassifier& classifier) :
+    word_vocab_size_(classifier.word_vocab_size_),
+    word_embed_size_(classifier.word_embed_size_),
+    word_feature_size_(classifier.word_feature_size_),
+    pos_vocab_size_(classifier.pos_vocab_size_),
+    pos_embed_size_(classifier.pos_embed_size_),
+    pos_feature_size_(classifier.pos_feature_size_),
+    label_vocab_size_(classifier.label_vocab_size_),
+    label_embed_size_(classifier.label_embed_size_),
+    label_feature_size_(classifier.label_feature_size_),
+    hidden1_size_(classifier.hidden1_size_),
+    hidden2_size_(classifier.hidden2_size_),
+    output_size_(classifier.output_size_) {
+  load(classifier);
+}
+
+NativeMlpClassifier::NativeMlpClassifier(
+    std::shared_ptr<const ModelBundle> bundle) :
+    word_vocab_size_(bundle->architecture().word_vocab_size),
+    word_embed_size_(bundle->architecture().word_embed_size),
+    word_feature_size_(bundle->architecture().word_feature_size),
+    pos_vocab_size_(bundle->architecture().pos_vocab_size),
+    pos_embed_size_(bundle->architecture().pos_embed_size),
+    pos_feature_size_(bundle->architecture().pos_feature_size),
+    label_vocab_size_(bundle->architecture().label_vocab_size),
+    label_embed_size_(bundle->architecture().label_embed_size),
+    label_feature_size_(bundle->architecture().label_feature_size),
+    hidden1_size_(bundle->architecture().hidden1_size),
+    hidden2_size_(bundle->architecture().hidden2_size),
+    output_size_(bundle->architecture().output_size),
+    bundle_(std::move(bundle)) {
+  const float* offset = bundle_->weights();
+  size_t total_size = 0;
+  for (auto& entry : layout()) {
+    *entry.first = offset;
+    offset += aligned(entry.second);
+    total_size += aligned(entry.second);
+  }
+  if (total_size != bundle_->weightsSize()) {
+    TRANSITIONPARSER_EXCEPTION(
+        "the model has {} floats of weights, its architecture needs {}.",
+        bundle_->weightsSize(), total_size);
+  }
+  LOG_DEBUG("native classifier mapped: {} floats", total_size);
+}
+
+void NativeMlpClassifier::save(const std::string& filepath) const {
+  std::vector<ModelBundle::Tensor> tensors;
+  for (auto& entry : const_cast<NativeMlpClassifier*>(this)->layout()) {
+    TRANSITIONPARSER_ASSERT(*entry.first != nullptr,
+                            "the float weights have been discarded");
+    tensors.emplace_back(*entry.first, entry.second);
+  }
+  ModelBundle::write(filepath, architecture(), tensors);
+}
+
+ModelBundle::Architecture NativeMlpClassifier::architecture() const {
+  return {word_vocab_size_, word_embed_size_, word_feature_size_,
+          pos_vocab_size_, pos_embed_size_, pos_feature_size_,
+          label_vocab_size_, label_embed_size_, label_feature_size_,
+          hidden1_size_, hidden2_size_, output_size_};
+}
+
+void NativeMlpClassifier::load(const MlpClassifier& classifier) {
+  const std::vector<std::pair<const dynet::Tensor*, const float**>> tensors = {
+      {&classifier.p_lookup_w_.get_storage().all_values, &lookup_w_},
+      {&classifier.p_lookup_p_.get_storage().all_values, &lookup_p_},
+      {&classifier.p_lookup_l_.get_storage().all_values, &lookup_l_},
+      {&classifier.p_W1_.get_storage().values, &W1_},
+      {&classifier.p_b1_.get_storage().values, &b1_},
+      {&classifier.p_W2_.get_storage().values, &W2_},
+      {&classifier.p_b2_.get_storage().values, &b2_},
+      {&classifier.p_W3_.get_storage().values, &W3_},
+      {&classifier.p_b3_.get_storage().values, &b3_},
+  };
+  std::vector<std::vector<float>> values;
+  values.reserve(tensors.size());
+  size_t total_size = 0;
+  for (const auto& tensor : tensors) {
+    values.push_back(dynet::as_vector(*tensor.first));
+    total_size += aligned(values.back().size());
+  }
+  storage_.assign(total_size, 0.0f);
+  float* offset = storage_.data();
+  for (unsigned i = 0; i < tensors.size(); ++i) {
+    std::copy(values[i].begin(), values[i].end(), offset);
+    *tensors[i].second = offset;
+    offset += aligned(values[i].size());
+  }
+  bundle_.reset();
+  LOG_DEBUG("native classifier loaded: {} floats", total_size);
+  if (!precomputed_.empty()) buildPrecomputed();
+}
+
+void NativeMlpClassifier::precompute(const std::vector<unsigned>& words) {
+  TRANSITIONPARSER_ASSERT(W1_ != nullptr,
+                          "precomputation requires the float W1 weights");
+  precomputed_words_.clear();
+  for (unsigned word : words) {
+    if (word < word_vocab_size_) precomputed_words_.push_back(word);
+  }
+  buildPrecomputed();
+}
+
+void NativeMlpClassifier::buildPrecomputed() {
+  const size_t num_words = precomputed_words_.size();
+  word_cache_index_.assign(word_vocab_size_, -1);
+  Eigen::MatrixXf words(word_embed_size_, num_words);
+  for (size_t i = 0; i < num_words; ++i) {
+    word_cache_index_[precomputed_words_[i]] = i;
+    words.col(i) = ConstVectorMap(
+        lookup_w_ + precomputed_words_[i] * word_embed_size_,
+        word_embed_size_);
+  }
+  ConstMatrixMap pos(lookup_p_, pos_embed_size_, pos_vocab_size_);
+  ConstMatrixMap labels(lookup_l_, label_embed_size_, label_vocab_size_);
+  ConstMatrixMap W1(W1_, hidden1_size_, inputSize());
+
+  precomputed_.resize((word_feature_size_ * num_words
+                       + pos_feature_size_ * pos_vocab_size_
+                       + label_feature_size_ * label_vocab_size_)
+                      * hidden1_size_);
+  float* block = precomputed_.data();
+  unsigned column = 0;
+  for (unsigned i = 0; i < word_feature_size_; ++i) {
+    MatrixMap(block, hidden1_size_, num_words).noalias() =
+        W1.middleCols(column, word_embed_size_) * words;
+    block += hidden1_size_ * num_words;
+    column += word_embed_size_;
+  }
+  for (unsigned i = 0; i < pos_feature_size_; ++i) {
+    MatrixMap(block, hidden1_size_, pos_vocab_size_).noalias() =
+        W1.middleCols(column, pos_embed_size_) * pos;
+    block += hidden1_size_ * pos_vocab_size_;
+    column += pos_embed_size_;
+  }
+  for (unsigned i = 0; i < label_feature_size_; ++i) {
+    MatrixMap(block, hidden1_size_, label_vocab_size_).noalias() =
+        W1.middleCols(column, label_embed_size_) * labels;
+    block += hidden1_size_ * label_vocab_size_;
+    column += label_embed_size_;
+  }
+  LOG_DEBUG("precomputed {} words: {} floats",
+            num_words, precomputed_.size());
+}
+
+std::vector<float> NativeMlpClassifier::compute(const FeatureVector& feature) {
+  LOG_TRACE("feature: {}", feature);
+  FeatureMatrix& single = workspace().single;
+  single.resize(1);
+  single.set(0, feature);
+  std::vector<float> scores(output_size_);
+  forward(single, scores.data());
+  return scores;
+}
+
+std::vector<std::vector<float>> NativeMlpClassifier::compute_batch(
+    const std::vector<FeatureVector>& features) {
+  size_t batch_size = features.size();
+  std::vector<float> v(batch_size * output_size_);
+  forward(FeatureMatrix(features), v.data());
+
+  std::vector<std::vector<float>> score_matrix;
+  score_matrix.reserve(batch_size);
+  auto start = v.begin();
+  for (size_t i = 0; i < batch_size; ++i) {
+    score_matrix.emplace_back(start, start + output_size_);
+    start += output_size_;
+  }
+  return score_matrix;
+}
+
+void NativeMlpClassifier::compute_batch(const FeatureMatrix& features,
+                                        std::vector<float>* scores) {
+  scores->resize(features.batchSize() * output_size_);
+  forward(features, scores->data());
+}
+
+std::vector<std::pair<const float**, size_t>> NativeMlpClassifier::layout() {
+  return {
+      {&lookup_w_, word_embed_size_ * word_vocab_size_},
+      {&lookup_p_, pos_embed_size_ * pos_vocab_size_},
+      {&lookup_l_, label_embed_size_ * label_vocab_size_},
+      {&W1_, hidden1_size_ * inputSize()},
+      {&b1_, hidden1_size_},
+      {&W2_, hidden2_size_ * hidden1_size_},
+      {&b2_, hidden2_size_},
+      {&W3_, output_size_ * hidden2_size_},
+      {&b3_, output_size_},
+  };
+}
+
+void NativeMlpClassifier::discard(const std::vector<const float**>& weights) {
+  if (bundle_ != nullptr) {
+    // the mapped weights are not copied, so there is nothing to release
+    for (const float** weight : weights) {
+      *weight = nullptr;
+    }
+    return;
+  }
+  auto entries = layout();
+  size_t total_size = 0;
+  for (auto& entry : entries) {
+    if (std::find(weights.begin(), weights.end(), entry.first)
+        != weights.end()) {
+      *entry.first = nullptr;
+    } else if (*entry.first != nullptr) {
+      total_size += aligned(entry.second);
+    }
+  }
+  std::vector<float> storage(total_size, 0.0f);
+  float* offset = storage.data();
+  for (auto& entry : entries) {
+    if (*entry.first == nullptr) continue;
+    std::copy_n(*entry.first, entry.second, offset);
+    *entry.first = offset;
+    offset += aligned(entry.second);
+  }
+  storage_.swap(storage);
+}
+
+unsigned NativeMlpClassifier::inputSize() const {
+  return word_feature_size_ * word_embed_size_
+      + pos_feature_size_ * pos_embed_size_
+      + label_feature_size_ * label_embed_size_;
+}
+
+void NativeMlpClassifier::forward(const FeatureMatrix& features,
+                                  float* scores) const {
+  const size_t batch_size = features.batchSize();
+  Workspace& buffers = workspace();
+  MatrixMap h1(reserve(&buffers.h1, hidden1_size_ * batch_size),
+               hidden1_size_, batch_size);
+  if (precomputed_.empty()) {
+    const unsigned input_size = inputSize();
+    MatrixMap h0(reserve(&buffers.h0, input_size * batch_size),
+                 input_size, batch_size);
+    embed(features, h0.data());
+    ConstMatrixMap W1(W1_, hidden1_size_, input_size);
+    ConstVectorMap b1(b1_, hidden1_size_);
+    h1.noalias() = W1 * h0;
+    h1.colwise() += b1;
+  } else {
+    hidden1(features, h1.data());
+  }
+  h1 = h1.cwiseMax(0.0f);
+
+  ConstMatrixMap W2(W2_, hidden2_size_, hidden1_size_);
+  ConstVectorMap b2(b2_, hidden2_size_);
+  MatrixMap h2(reserve(&buffers.h2, hidden2_size_ * batch_size),
+               hidden2_size_, batch_size);
+  h2.noalias() = W2 * h1;
+  h2.colwise() += b2;
+  h2 = h2.cwiseMax(0.0f);
+
+  ConstMatrixMap W3(W3_, output_size_, hidden2_size_);
+  ConstVectorMap b3(b3_, output_size_);
+  MatrixMap y(scores, output_size_, batch_size);
+  y.noalias() = W3 * h2;
+  y.colwise() += b3;
+}
+
+// Writes the concatenation of the embeddings of each sample, in the same
+// order as MlpClassifier::run. The slots are visited in the order in which
+// the matrix stores them.
+void NativeMlpClassifier::embed(const FeatureMatrix& features,
+                                float* h0) const {
+  const size_t batch_size = features.batchSize();
+  const unsigned input_size = inputSize();
+  unsigned j = 0;
+  unsigned offset = 0;
+  auto copy = [&](const float* lookup, unsigned embed_size) {
+    const unsigned* ids = features.slot(j++);
+    for (size_t i = 0; i < batch_size; ++i) {
+      std::copy_n(lookup + ids[i] * embed_size, embed_size,
+                  h0 + i * input_size + offset);
+    }
+    offset += embed_size;
+  };
+  for (unsigned k = 0; k < word_feature_size_; ++k) {
+    copy(lookup_w_, word_embed_size_);
+  }
+  for (unsigned k = 0; k < pos_feature_size_; ++k) {
+    copy(lookup_p_, pos_embed_size_);
+  }
+  for (unsigned k = 0; k < label_feature_size_; ++k) {
+    copy(lookup_l_, label_embed_size_);
+  }
+}
+
+// Computes W1 * h0 + b1 from the precomputed columns. Rare words whose
+// products are not cached are multiplied with their block of W1 directly.
+void NativeMlpClassifier::hidden1(const FeatureMatrix& features,
+                                  float* h1) const {
+  const size_t batch_size = features.batchSize();
+  const size_t num_words = precomputed_words_.size();
+  ConstMatrixMap W1(W1_, hidden1_size_, inputSize());
+  MatrixMap h(h1, hidden1_size_, batch_size);
+  h.colwise() = ConstVectorMap(b1_, hidden1_size_);
+
+  const float* block = precomputed_.data();
+  unsigned column = 0;
+  unsigned j = 0;
+  for (unsigned k = 0; k < word_feature_size_; ++k) {
+    const unsigned* ids = features.slot(j++);
+    for (size_t i = 0; i < batch_size; ++i) {
+      const unsigned word = ids[i];
+      const int cache_index = word_cache_index_[word];
+      if (cache_index >= 0) {
+        h.col(i) += ConstVectorMap(block + cache_index * hidden1_size_,
+                                   hidden1_size_);
+      } else {
+        h.col(i).noalias() += W1.middleCols(column, word_embed_size_)
+            * ConstVectorMap(lookup_w_ + word * word_embed_size_,
+                             word_embed_size_);
+      }
+    }
+    block += hidden1_size_ * num_words;
+    column += word_embed_size_;
+  }
+  auto add = [&](unsigned vocab_size) {
+    const unsigned* ids = features.slot(j++);
+    for (size_t i = 0; i < batch_size; ++i) {
+      h.col(i) += ConstVectorMap(block + ids[i] * hidden1_size_,
+                                 hidden1_size_);
+    }
+    block += hidden1_size_ * vocab_size;
+  };
+  for (unsigned k = 0; k < pos_feature_size_; ++k) add(pos_vocab_size_);
+  for (unsigned k = 0; k < label_feature_size_; ++k) add(label_vocab_size_);
+}
+
+QuantizedMlpClassifier::QuantizedMlpClassifier(
+    const MlpClassifier& classifier) : NativeMlpClassifier(classifier) {
+  quantize();
+}
+
+QuantizedMlpClassifier::QuantizedMlpClassifier(
+    std::shared_ptr<const ModelBundle> bundle) :
+    NativeMlpClassifier(std::move(bundle)) {
+  quantize();
+}
+
+void QuantizedMlpClassifier::load(const MlpClassifier& classifier) {
+  NativeMlpClassifier::load(classifier);
+  quantize();
+}
+
+void QuantizedMlpClassifier::quantize() {
+  quantize_rows(W1_, hidden1_size_, inputSize(), &W1_q_, &W1_scales_);
+  quantize_rows(W2_, hidden2_size_, hidden1_size_, &W2_q_, &W2_scales_);
+  discard({&W1_, &W2_});
+  LOG_DEBUG("quantized hidden layers: {} bytes",
+            W1_q_.size() + W2_q_.size());
+}
+
+void QuantizedMlpClassifier::forward(const FeatureMatrix& features,
+                                     float* scores) const {
+  const size_t batch_size = features.batchSize();
+  const unsigned input_size = inputSize();
+  Workspace& buffers = workspace();
+  float* h0 = reserve(&buffers.h0, input_size * batch_size);
+  float* h1 = reserve(&buffers.h1, hidden1_size_);
+  int8_t* quantized = reserve(&buffers.quantized,
+                              std::max(input_size, hidden1_size_));
+  MatrixMap h2(reserve(&buffers.h2, hidden2_size_ * batch_size),
+               hidden2_size_, batch_size);
+  embed(features, h0);
+  for (size_t i = 0; i < batch_size; ++i) {
+    float scale = quantize_vector(h0 + i * input_size, input_size, quantized);
+    gemv_relu(W1_q_.data(), W1_scales_.data(), hidden1_size_, input_size,
+              quantized, scale, b1_, h1);
+    scale = quantize_vector(h1, hidden1_size_, quantized);
+    gemv_relu(W2_q_.data(), W2_scales_.data(), hidden2_size_, hidden1_size_,
+              quantized, scale, b2_, h2.col(i).data());
+  }
+
+  ConstMatrixMap W3(W3_, output_size_, hidden2_size_);
+  ConstVectorMap b3(b3_, output_size_);
+  MatrixMap y(scores, output_size_, batch_size);
+  y.noalias() = W3 * h2;
+  y.colwise() += b3;
+}
+
+}  // namespace transitionparser
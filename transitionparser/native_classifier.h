@@ -0,0 +1,138 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#ifndef TRANSITIONPARSER_NATIVE_CLASSIFIER_H_
+#define TRANSITIONPARSER_NATIVE_CLASSIFIER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "transitionparser/classifier.h"
+#include "transitionparser/feature.h"
+#include "transitionparser/model_bundle.h"
+#include "transitionparser/utility.h"
+
+namespace transitionparser {
+
+// Inference-only counterpart of MlpClassifier. The weights are copied once
+// into a single contiguous buffer and the forward pass is computed directly
+// with Eigen, so no computation graph is built per parser step. The weights
+// are read-only during inference and the activations live in per-thread
+// workspaces, so one instance can be shared by several parser threads.
+class NativeMlpClassifier : public Classifier {
+ public:
+  explicit NativeMlpClassifier(const MlpClassifier& classifier);
+
+  // Reads the weights in place from a model bundle, which is kept open as
+  // long as the classifier uses it.
+  explicit NativeMlpClassifier(std::shared_ptr<const ModelBundle> bundle);
+
+  // Writes the hyperparameters, the weights and the current dictionaries to
+  // a model bundle.
+  void save(const std::string& filepath) const;
+
+  // Copies the current weights of the classifier, e.g. after an epoch.
+  virtual void load(const MlpClassifier& classifier);
+
+  // Caches the products of W1's column blocks with the embeddings of the
+  // given words and of every POS and label id (Chen and Manning, 2014), so
+  // that the first hidden layer is computed by summing one cached column per
+  // feature slot. Words outside the list fall back to the full multiply.
+  void precompute(const std::vector<unsigned>& words);
+
+  std::vector<float> compute(const FeatureVector& feature) override;
+
+  std::vector<std::vector<float>> compute_batch(
+      const std::vector<FeatureVector>& features) override;
+
+  void compute_batch(const FeatureMatrix& features,
+                     std::vector<float>* scores) override;
+
+  bool isThreadSafe() const override { return true; }
+
+  unsigned inputSize() const;
+
+ protected:
+  virtual void forward(const FeatureMatrix& features, float* scores) const;
+
+  // Writes the concatenated embeddings of each sample to a column of h0.
+  void embed(const FeatureMatrix& features, float* h0) const;
+
+  // Writes W1 * h0 + b1 of each sample to a column of h1.
+  void hidden1(const FeatureMatrix& features, float* h1) const;
+
+  void buildPrecomputed();
+
+  std::vector<std::pair<const float**, size_t>> layout();
+
+  ModelBundle::Architecture architecture() const;
+
+  // Drops the given weights from the buffer and resets their pointers.
+  void discard(const std::vector<const float**>& weights);
+
+  const unsigned word_vocab_size_;
+  const unsigned word_embed_size_;
+  const unsigned word_feature_size_;
+  const unsigned pos_vocab_size_;
+  const unsigned pos_embed_size_;
+  const unsigned pos_feature_size_;
+  const unsigned label_vocab_size_;
+  const unsigned label_embed_size_;
+  const unsigned label_feature_size_;
+  const unsigned hidden1_size_;
+  const unsigned hidden2_size_;
+  const unsigned output_size_;
+
+  // column-major matrices laid out one after another in `storage_`, or in
+  // the weights of `bundle_` when the classifier was loaded from one
+  std::vector<float> storage_;
+  std::shared_ptr<const ModelBundle> bundle_;
+  const float* lookup_w_ = nullptr;
+  const float* lookup_p_ = nullptr;
+  const float* lookup_l_ = nullptr;
+  const float* W1_ = nullptr;
+  const float* b1_ = nullptr;
+  const float* W2_ = nullptr;
+  const float* b2_ = nullptr;
+  const float* W3_ = nullptr;
+  const float* b3_ = nullptr;
+
+  // slot-major blocks of hidden1-sized columns: one column per cached word
+  // for each word slot, then one per id for each POS and label slot
+  std::vector<unsigned> precomputed_words_;
+  std::vector<int> word_cache_index_;
+  std::vector<float> precomputed_;
+};
+
+// Post-training int8 quantization of MlpClassifier. W1 and W2 are stored as
+// int8 with one scale per row and multiplied with int8 activations that are
+// quantized per sample, accumulating in int32. The embeddings and the output
+// layer stay in float; the float copies of W1 and W2 are released.
+class QuantizedMlpClassifier : public NativeMlpClassifier {
+ public:
+  explicit QuantizedMlpClassifier(const MlpClassifier& classifier);
+
+  explicit QuantizedMlpClassifier(std::shared_ptr<const ModelBundle> bundle);
+
+  void load(const MlpClassifier& classifier) override;
+
+ protected:
+  void forward(const FeatureMatrix& features, float* scores) const override;
+
+  void quantize();
+
+  // row-major int8 matrices
+  std::vector<int8_t> W1_q_;
+  std::vector<float> W1_scales_;
+  std::vector<int8_t> W2_q_;
+  std::vector<float> W2_scales_;
+};
+
+}  // namespace transitionparser
+
+#endif  // TRANSITIONPARSER_NATIVE_CLASSIFIER_H_
@@ -0,0 +1,98 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include "transitionparser/optimizer.h"
+
+#include <cmath>
+
+namespace transitionparser {
+
+std::unique_ptr<SparseOptimizer> SparseOptimizer::create(
+    const std::string& name) {
+  if (name == "sgd") {
+    return std::unique_ptr<SparseOptimizer>(new SparseSgd());
+  } else if (name == "adagrad") {
+    return std::unique_ptr<SparseOptimizer>(new SparseAdagrad());
+  } else if (name == "adam") {
+    return std::unique_ptr<SparseOptimizer>(new SparseAdam());
+  }
+  TRANSITIONPARSER_EXCEPTION("unknown optimizer '{}'.", name);
+}
+
+unsigned SparseOptimizer::addTable(const unsigned num_rows,
+                                   const unsigned dim) {
+  tables_.push_back({num_rows, dim, {}, {}, {}});
+  return tables_.size() - 1;
+}
+
+void SparseSgd::update(const unsigned table, float* values,
+                       const float* grads,
+                       const std::vector<unsigned>& rows) {
+  const unsigned dim = tables_[table].dim;
+  for (unsigned row : rows) {
+    float* w = values + static_cast<size_t>(row) * dim;
+    const float* g = grads + static_cast<size_t>(row) * dim;
+    for (unsigned i = 0; i < dim; ++i) {
+      w[i] -= learning_rate_ * g[i];
+    }
+  }
+}
+
+void SparseAdagrad::update(const unsigned table, float* values,
+                           const float* grads,
+                           const std::vector<unsigned>& rows) {
+  Table& state = tables_[table];
+  const unsigned dim = state.dim;
+  if (state.second.empty()) {
+    state.second.resize(static_cast<size_t>(state.num_rows) * dim, 0.0f);
+  }
+  for (unsigned row : rows) {
+    const size_t offset = static_cast<size_t>(row) * dim;
+    float* w = values + offset;
+    const float* g = grads + offset;
+    float* v = state.second.data() + offset;
+    for (unsigned i = 0; i < dim; ++i) {
+      v[i] += g[i] * g[i];
+      w[i] -= learning_rate_ * g[i] / std::sqrt(v[i] + epsilon_);
+    }
+  }
+}
+
+void SparseAdam::update(const unsigned table, float* values,
+                        const float* grads,
+                        const std::vector<unsigned>& rows) {
+  Table& state = tables_[table];
+  const unsigned dim = state.dim;
+  if (state.first.empty()) {
+    const size_t size = static_cast<size_t>(state.num_rows) * dim;
+    state.first.resize(size, 0.0f);
+    state.second.resize(size, 0.0f);
+    state.last_step.resize(state.num_rows, 0);
+  }
+  TRANSITIONPARSER_ASSERT(num_steps_ > 0, "step() has not been called");
+  const unsigned t = num_steps_;
+  const float correction1 = 1.0f - std::pow(beta1_, t);
+  const float correction2 = 1.0f - std::pow(beta2_, t);
+  for (unsigned row : rows) {
+    const size_t offset = static_cast<size_t>(row) * dim;
+    float* w = values + offset;
+    const float* g = grads + offset;
+    float* m = state.first.data() + offset;
+    float* v = state.second.data() + offset;
+    // the decay of the steps since the last update of the row
+    const unsigned skipped = t - state.last_step[row] - 1;
+    const float decay1 = skipped > 0 ? std::pow(beta1_, skipped) : 1.0f;
+    const float decay2 = skipped > 0 ? std::pow(beta2_, skipped) : 1.0f;
+    state.last_step[row] = t;
+    for (unsigned i = 0; i < dim; ++i) {
+      m[i] = beta1_ * decay1 * m[i] + (1.0f - beta1_) * g[i];
+      v[i] = beta2_ * decay2 * v[i] + (1.0f - beta2_) * g[i] * g[i];
+      w[i] -= learning_rate_ * (m[i] / correction1)
+          / (std::sqrt(v[i] / correction2) + epsilon_);
+    }
+  }
+}
+
+}  // namespace transitionparser
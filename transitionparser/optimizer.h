@@ -0,0 +1,111 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#ifndef TRANSITIONPARSER_OPTIMIZER_H_
+#define TRANSITIONPARSER_OPTIMIZER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "transitionparser/utility.h"
+
+namespace transitionparser {
+
+// Lazy updates of embedding tables: a step only reads and writes the rows
+// that have a gradient, so its cost depends on the batch rather than on the
+// vocabulary size. A table holds `num_rows` contiguous rows of `dim` values
+// and its gradients are laid out the same way.
+class SparseOptimizer {
+ public:
+  SparseOptimizer() {}
+  virtual ~SparseOptimizer() {}
+
+  // Returns an optimizer with the default hyperparameters of the DyNet
+  // trainer of the same name: "sgd", "adagrad" or "adam".
+  static std::unique_ptr<SparseOptimizer> create(const std::string& name);
+
+  // Registers a table and returns its id.
+  unsigned addTable(unsigned num_rows, unsigned dim);
+
+  // Starts the next step; every table is updated at most once per step.
+  void step() {
+    ++num_steps_;
+  }
+
+  // Updates the given rows of a table from their gradients.
+  virtual void update(unsigned table, float* values, const float* grads,
+                      const std::vector<unsigned>& rows) = 0;
+
+ protected:
+  struct Table {
+    unsigned num_rows;
+    unsigned dim;
+    // per-value state of the optimizer, allocated on demand
+    std::vector<float> first;
+    std::vector<float> second;
+    // the step at which each row was updated last
+    std::vector<unsigned> last_step;
+  };
+
+  std::vector<Table> tables_;
+  unsigned num_steps_ = 0;
+
+ private:
+  DISALLOW_COPY_AND_MOVE(SparseOptimizer);
+};
+
+class SparseSgd : public SparseOptimizer {
+ public:
+  explicit SparseSgd(float learning_rate = 0.1f) :
+      learning_rate_(learning_rate) {}
+
+  void update(unsigned table, float* values, const float* grads,
+              const std::vector<unsigned>& rows) override;
+
+ private:
+  const float learning_rate_;
+};
+
+// The squared gradients of a row only grow while it has a gradient, so the
+// lazy update is exactly the dense one.
+class SparseAdagrad : public SparseOptimizer {
+ public:
+  explicit SparseAdagrad(float learning_rate = 0.1f, float epsilon = 1e-20f) :
+      learning_rate_(learning_rate), epsilon_(epsilon) {}
+
+  void update(unsigned table, float* values, const float* grads,
+              const std::vector<unsigned>& rows) override;
+
+ private:
+  const float learning_rate_;
+  const float epsilon_;
+};
+
+// The moments of a row decay at every step, also when it has no gradient.
+// The decay of the skipped steps is deferred to the next step that touches
+// the row, which then sees the same moments as a dense update would. The
+// parameter moves the dense update makes in the skipped steps are dropped,
+// as in lazy Adam.
+class SparseAdam : public SparseOptimizer {
+ public:
+  explicit SparseAdam(float learning_rate = 0.001f, float beta1 = 0.9f,
+                      float beta2 = 0.999f, float epsilon = 1e-8f) :
+      learning_rate_(learning_rate), beta1_(beta1), beta2_(beta2),
+      epsilon_(epsilon) {}
+
+  void update(unsigned table, float* values, const float* grads,
+              const std::vector<unsigned>& rows) override;
+
+ private:
+  const float learning_rate_;
+  const float beta1_;
+  const float beta2_;
+  const float epsilon_;
+};
+
+}  // namespace transitionparser
+
+#endif  // TRANSITIONPARSER_OPTIMIZER_H_
@@ -9,6 +9,10 @@
 #include <dynet/tensor.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <thread>  // NOLINT(build/c++11)
 #include <utility>
 #include <vector>
 
@@ -20,14 +24,58 @@ namespace transitionparser {
 Parser::Parser(std::shared_ptr<Classifier> classifier) :
     classifier_(classifier) {}
 
-GreedyParser::GreedyParser(std::shared_ptr<Classifier> classifier) :
-    Parser(classifier) {}
+std::vector<int> Parser::sortByLength(const std::vector<Sentence>& sentences) {
+  std::vector<int> indices(sentences.size());
+  std::iota(std::begin(indices), std::end(indices), 0);
+  std::sort(indices.begin(), indices.end(),
+            [&sentences](size_t idx1, size_t idx2) {
+              return sentences[idx1].length < sentences[idx2].length;
+            });
+  return indices;
+}
+
+void Parser::parse_stream(const Source& source, const size_t window_size,
+                          const size_t batch_size, const Sink& sink) {
+  TRANSITIONPARSER_ASSERT(window_size > 0, "window size must be positive");
+  std::vector<Sentence> window;
+  window.reserve(window_size);
+  std::vector<const State*> ordered;
+  bool remaining = true;
+  while (remaining) {
+    window.clear();
+    while (window.size() < window_size && (remaining = source(&window))) {}
+    if (window.empty()) break;
+    auto states = parse_batch(window, batch_size);
+    std::vector<int> indices = sortByLength(window);
+    ordered.assign(window.size(), nullptr);
+    for (size_t i = 0; i < states.size(); ++i) {
+      ordered[indices[i]] = states[i].get();
+    }
+    for (const State* state : ordered) {
+      sink(*state);
+    }
+  }
+}
+
+GreedyParser::GreedyParser(std::shared_ptr<Classifier> classifier,
+                           const unsigned num_threads,
+                           const bool continuous,
+                           const bool pipelined) :
+    Parser(classifier), num_threads_(num_threads), continuous_(continuous),
+    pipelined_(pipelined) {
+  // the slots of a continuous batch are refilled one at a time, so there are
+  // no fixed halves to overlap
+  TRANSITIONPARSER_ASSERT(
+      !(continuous_ && pipelined_),
+      "continuous and pipelined parsing exclude each other");
+}
 
 std::unique_ptr<State> GreedyParser::parse(const Sentence& sentence) {
   std::unique_ptr<State> state = std::make_unique<State>(sentence);
+  FeatureVector feature(Feature::kNFeatures);
   while (!Transition::isTerminal(*state)) {
     // retrieve an one best action greedily
-    Transition::apply(getNextAction(*state), state.get());
+    Transition::apply(getNextAction(*state, &feature), state.get());
   }
   return state;
 }
@@ -39,25 +87,277 @@ std::vector<std::unique_ptr<State>> GreedyParser::parse_batch(
 
 std::vector<std::unique_ptr<State>> GreedyParser::parse_batch(
     const std::vector<Sentence>& sentences, const size_t batch_size) {
+  return parse_batch(sentences, batch_size, num_threads_);
+}
+
+// Batches of length-sorted sentences are handed out through a shared counter,
+// longest first, so that idle threads keep taking the remaining batches. In
+// continuous mode the states are handed out one at a time instead.
+std::vector<std::unique_ptr<State>> GreedyParser::parse_batch(
+    const std::vector<Sentence>& sentences, const size_t batch_size,
+    const unsigned num_threads) {
+  TRANSITIONPARSER_ASSERT(num_threads <= 1 || classifier_->isThreadSafe(),
+                          "the classifier cannot be shared between threads");
+  if (sentences.empty()) return {};
   size_t num_sentences = sentences.size();
-  size_t num_batches = num_sentences / batch_size + 1;
+  size_t num_batches = (num_sentences + batch_size - 1) / batch_size;
 
+  std::vector<int> indices = sortByLength(sentences);
   std::vector<std::unique_ptr<State>> states;
   states.reserve(num_sentences);
+  for (size_t i = 0; i < num_sentences; ++i) {
+    states.push_back(std::make_unique<State>(sentences.at(indices[i])));
+  }
 
-  std::vector<int> indices(num_sentences);
-  std::iota(std::begin(indices), std::end(indices), 0);
-  std::sort(indices.begin(), indices.end(),
-            [&sentences](size_t idx1, size_t idx2) {
-              return sentences[idx1].length < sentences[idx2].length;
-            });
+  std::atomic<size_t> next_batch(0);
+  std::atomic<size_t> next_state(0);
+  auto worker = [&]() {
+    if (continuous_) {
+      parseContinuously(states, batch_size, &next_state);
+      return;
+    }
+    std::vector<State*> targets;
+    targets.reserve(batch_size);
+    // one helper thread per worker, kept for all of its batches
+    std::unique_ptr<utility::thread::Worker> helper;
+    if (pipelined_) helper = std::make_unique<utility::thread::Worker>();
+    size_t batch_index;
+    while ((batch_index = next_batch++) < num_batches) {
+      LOG_TRACE("parse batch {} of {}", batch_index + 1, num_batches);
+      size_t offset = (num_batches - 1 - batch_index) * batch_size;
+      const size_t current_batch_size =
+          std::min(num_sentences - offset, batch_size);
+      targets.clear();
+      for (size_t i = offset; i < offset + current_batch_size; ++i) {
+        targets.push_back(states[i].get());
+      }
+      if (pipelined_) {
+        parsePipelined(&targets, helper.get());
+      } else {
+        parseStates(&targets);
+      }
+    }
+  };
+
+  if (num_threads <= 1) {
+    worker();
+  } else {
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (unsigned i = 0; i < num_threads; ++i) {
+      threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  return states;
+}
 
+// Runs the states to completion; the vector is used as scratch space.
+void GreedyParser::parseStates(std::vector<State*>* targets) {
+  std::vector<State*> temp;
+  temp.reserve(targets->size());
+  // the matrix and the scores keep their capacity across steps
+  FeatureMatrix features;
+  std::vector<float> scores;
+
+  while (true) {
+    temp.clear();
+    temp.assign(targets->begin(), targets->end());
+    targets->clear();
+    for (const auto& state : temp) {
+      if (!Transition::isTerminal(*state)) {
+        targets->push_back(state);
+      }
+    }
+    if (targets->empty()) break;
+    advance(*targets, &features, &scores);
+  }
+}
+
+// Keeps up to `batch_size` states in flight and replaces each finished one
+// with the next pending state, longest first, so that the classifier runs at
+// full width until the pending states run out.
+void GreedyParser::parseContinuously(
+    const std::vector<std::unique_ptr<State>>& states,
+    const size_t batch_size, std::atomic<size_t>* next_state) {
   std::vector<State*> targets;
   targets.reserve(batch_size);
-  std::vector<State*> temp;
-  temp.reserve(batch_size);
-  std::vector<FeatureVector> features;
-  features.reserve(batch_size);
+  FeatureMatrix features;
+  std::vector<float> scores;
+  bool exhausted = false;
+  while (true) {
+    size_t num_active = 0;
+    for (State* state : targets) {
+      if (!Transition::isTerminal(*state)) {
+        targets[num_active++] = state;
+      }
+    }
+    targets.resize(num_active);
+    while (!exhausted && targets.size() < batch_size) {
+      const size_t index = (*next_state)++;
+      if (index >= states.size()) {
+        exhausted = true;
+      } else if (!Transition::isTerminal(*states[states.size() - 1 - index])) {
+        targets.push_back(states[states.size() - 1 - index].get());
+      }
+    }
+    if (targets.empty()) break;
+    advance(targets, &features, &scores);
+  }
+}
+
+void GreedyParser::advance(const std::vector<State*>& states,
+                           FeatureMatrix* features,
+                           std::vector<float>* scores) {
+  if (states.empty()) return;
+  applyForced(states);
+  extract(states, features);
+  classifier_->compute_batch(*features, scores);
+  apply(states, *scores);
+}
+
+// The halves take turns: while the classifier scores one half on this
+// thread, the helper applies the actions of the other half, drops its
+// terminal states and extracts its next features.
+void GreedyParser::parsePipelined(std::vector<State*>* targets,
+                                  utility::thread::Worker* helper) {
+  struct Half {
+    std::vector<State*> states;
+    FeatureMatrix features;
+    std::vector<float> scores;
+  };
+  Half halves[2];
+  // the targets are sorted by length, so alternating balances the halves
+  for (size_t i = 0; i < targets->size(); ++i) {
+    State* state = (*targets)[i];
+    if (!Transition::isTerminal(*state)) {
+      halves[i % 2].states.push_back(state);
+    }
+  }
+  auto score = [this](Half* half) {
+    if (half->states.empty()) return;
+    classifier_->compute_batch(half->features, &half->scores);
+  };
+  auto step = [](Half* half) {
+    if (half->states.empty()) return;
+    apply(half->states, half->scores);
+    size_t num_active = 0;
+    for (State* state : half->states) {
+      if (!Transition::isTerminal(*state)) {
+        half->states[num_active++] = state;
+      }
+    }
+    half->states.resize(num_active);
+    applyForced(half->states);
+    extract(half->states, &half->features);
+  };
+
+  for (Half& half : halves) {
+    applyForced(half.states);
+    extract(half.states, &half.features);
+  }
+  score(&halves[0]);
+  for (int current = 0; !halves[0].states.empty() || !halves[1].states.empty();
+       current = 1 - current) {
+    // `scored` has its scores and `next` its features
+    Half* scored = &halves[current];
+    Half* next = &halves[1 - current];
+    helper->run([&step, scored]() { step(scored); });
+    try {
+      score(next);
+    } catch (...) {
+      // the helper still uses the halves
+      try {
+        helper->wait();
+      } catch (...) {}
+      throw;
+    }
+    helper->wait();
+  }
+}
+
+// A forced action is never terminal, so the state still needs its scores
+// for the next one.
+void GreedyParser::applyForced(const std::vector<State*>& states) {
+  for (State* state : states) {
+    const Action forced = Transition::forcedAction(*state);
+    if (forced != NoneAction) {
+      Transition::apply(forced, state);
+    }
+  }
+}
+
+void GreedyParser::extract(const std::vector<State*>& states,
+                           FeatureMatrix* features) {
+  features->resize(states.size());
+  for (size_t i = 0; i < states.size(); ++i) {
+    features->set(i, *states[i]);
+  }
+}
+
+void GreedyParser::apply(const std::vector<State*>& states,
+                         const std::vector<float>& scores) {
+  const size_t batch_size = states.size();
+  if (batch_size == 0) return;
+  const size_t num_actions = scores.size() / batch_size;
+  for (size_t i = 0; i < batch_size; ++i) {
+    State* state = states[i];
+    Transition::apply(
+        Transition::bestAllowed(scores.data() + i * num_actions, num_actions,
+                                Transition::allowedActionTypes(*state)),
+        state);
+  }
+}
+
+Action GreedyParser::getNextAction(const State& state,
+                                   FeatureVector* feature) {
+  LOG_TRACE("{}", state);
+  const Transition::ActionMask mask = Transition::allowedActionTypes(state);
+  if (mask == 1 << Transition::SHIFT) {
+    return Transition::shiftAction();
+  }
+  Feature::extract(state, feature->data());
+  std::vector<float> scores = classifier_->compute(*feature);
+  LOG_TRACE("scores: {}", scores);
+  Action best_action = Transition::bestAllowed(scores.data(), scores.size(),
+                                               mask);
+  LOG_TRACE("best action: {}", best_action);
+  return best_action;
+}
+
+BeamParser::BeamParser(std::shared_ptr<Classifier> classifier,
+                       const unsigned beam_width) :
+    Parser(classifier), beam_width_(beam_width) {
+  TRANSITIONPARSER_ASSERT(beam_width_ > 0, "beam width must be positive");
+}
+
+std::unique_ptr<State> BeamParser::parse(const Sentence& sentence) {
+  std::vector<Beam> beams(1);
+  beams[0].push_back(std::make_unique<State>(sentence));
+  search(&beams);
+  return std::move(beams[0].front());
+}
+
+std::vector<std::unique_ptr<State>> BeamParser::parse_batch(
+    const std::vector<Sentence>& sentences) {
+  return parse_batch(sentences, sentences.size());
+}
+
+std::vector<std::unique_ptr<State>> BeamParser::parse_batch(
+    const std::vector<Sentence>& sentences, const size_t batch_size) {
+  if (sentences.empty()) return {};
+  size_t num_sentences = sentences.size();
+  size_t num_batches = (num_sentences + batch_size - 1) / batch_size;
+
+  std::vector<std::unique_ptr<State>> states;
+  states.reserve(num_sentences);
+
+  std::vector<int> indices = sortByLength(sentences);
+  std::vector<Beam> beams;
+  beams.reserve(batch_size);
 
   for (unsigned batch_index = 0; batch_index < num_batches; ++batch_index) {
     LOG_TRACE("parse batch {} of {}", batch_index + 1, num_batches);
@@ -65,63 +365,104 @@ std::vector<std::unique_ptr<State>> GreedyParser::parse_batch(
     const size_t current_batch_size =
         std::min(num_sentences - offset, batch_size);
 
-    targets.clear();
-    temp.clear();
-    features.clear();
-
+    beams.clear();
     for (size_t i = offset; i < offset + current_batch_size; ++i) {
-      auto state = std::make_unique<State>(sentences.at(indices[i]));
-      targets.push_back(state.get());
-      states.push_back(std::move(state));
+      beams.emplace_back();
+      beams.back().push_back(
+          std::make_unique<State>(sentences.at(indices[i])));
+    }
+    search(&beams);
+    for (auto& beam : beams) {
+      states.push_back(std::move(beam.front()));
     }
+  }
 
-    while (true) {
-      temp.clear();
-      temp.assign(targets.begin(), targets.end());
-      targets.clear();
-      features.clear();
-      for (const auto& state : temp) {
+  return states;
+}
+
+unsigned BeamParser::beamWidth() const {
+  return beam_width_;
+}
+
+// Expands every beam until all of its items are terminal. On return the
+// best item of each beam is at the front.
+void BeamParser::search(std::vector<Beam>* beams) {
+  struct Candidate {
+    double score;
+    unsigned index;
+    Action action;
+  };
+  std::vector<Candidate> candidates;
+  std::vector<const State*> targets;
+  FeatureMatrix features;
+  std::vector<float> score_matrix;
+
+  while (true) {
+    targets.clear();
+    for (const auto& beam : *beams) {
+      for (const auto& state : beam) {
         if (!Transition::isTerminal(*state)) {
-          targets.push_back(state);
-          features.push_back(Feature::extract(*state));
+          targets.push_back(state.get());
         }
       }
-      if (targets.empty()) break;
-      std::vector<std::vector<float>> score_matrix =
-          classifier_->compute_batch(features);
-      for (unsigned i = 0; i < targets.size(); ++i) {
-        int best_action = -1;
-        float best_score = -INFINITY;
-        for (unsigned action = 0; action < score_matrix[i].size(); ++action) {
-          if (score_matrix[i][action] > best_score &&
-              Transition::isAllowed(action, *targets[i])) {
-            best_action = action;
-            best_score = score_matrix[i][action];
+    }
+    if (targets.empty()) break;
+    features.resize(targets.size());
+    for (size_t i = 0; i < targets.size(); ++i) {
+      features.set(i, *targets[i]);
+    }
+    classifier_->compute_batch(features, &score_matrix);
+    const size_t num_actions = score_matrix.size() / targets.size();
+
+    const float* row = score_matrix.data();
+    for (auto& beam : *beams) {
+      candidates.clear();
+      for (unsigned index = 0; index < beam.size(); ++index) {
+        const State& state = *beam[index];
+        if (Transition::isTerminal(state)) {
+          candidates.push_back({state.score(), index, NoneAction});
+          continue;
+        }
+        const float* scores = row;
+        row += num_actions;
+        float max_score = *std::max_element(scores, scores + num_actions);
+        double sum = 0.0;
+        for (unsigned action = 0; action < num_actions; ++action) {
+          sum += std::exp(scores[action] - max_score);
+        }
+        const double log_z = max_score + std::log(sum);
+        const Transition::ActionMask mask =
+            Transition::allowedActionTypes(state);
+        for (unsigned action = 0; action < num_actions; ++action) {
+          if (Transition::isAllowed(action, mask)) {
+            candidates.push_back(
+                {state.score() + scores[action] - log_z, index,
+                 static_cast<Action>(action)});
           }
         }
-        Transition::apply(best_action, targets[i]);
       }
-    }
-  }
 
-  return states;
-}
-
-Action GreedyParser::getNextAction(const State& state) {
-  LOG_TRACE("{}", state);
-  std::vector<float> scores =
-      classifier_->compute(std::move(Feature::extract(state)));
-  LOG_TRACE("scores: {}", scores);
-  int best_action = -1;
-  float best_score = -INFINITY;
-  for (unsigned i = 0; i < scores.size(); ++i) {
-    if (scores[i] > best_score && Transition::isAllowed(i, state)) {
-      best_action = i;
-      best_score = scores[i];
+      const size_t width = std::min<size_t>(beam_width_, candidates.size());
+      std::partial_sort(candidates.begin(), candidates.begin() + width,
+                        candidates.end(),
+                        [](const Candidate& lhs, const Candidate& rhs) {
+                          return lhs.score > rhs.score;
+                        });
+      Beam next;
+      next.reserve(width);
+      for (size_t i = 0; i < width; ++i) {
+        const Candidate& candidate = candidates[i];
+        if (candidate.action == NoneAction) {
+          next.push_back(std::move(beam[candidate.index]));
+        } else {
+          next.push_back(Transition::successor(candidate.action,
+                                               *beam[candidate.index]));
+          next.back()->setScore(candidate.score);
+        }
+      }
+      beam.swap(next);
     }
   }
-  LOG_TRACE("best action: {}", best_action);
-  return static_cast<Action>(best_action);
 }
 
 }  // namespace transitionparser
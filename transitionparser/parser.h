@@ -6,6 +6,8 @@
 #ifndef TRANSITIONPARSER_PARSER_H_
 #define TRANSITIONPARSER_PARSER_H_
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -25,7 +27,38 @@ class Parser {
 
   virtual std::unique_ptr<State> parse(const Sentence& sentence) = 0;
 
+  // Returns the states in the order of sortByLength(sentences).
+  virtual std::vector<std::unique_ptr<State>> parse_batch(
+      const std::vector<Sentence>& sentences, const size_t batch_size) = 0;
+
+  // Appends the next sentence to the vector, or returns false at the end.
+  typedef std::function<bool(std::vector<Sentence>*)> Source;
+
+  typedef std::function<void(const State&)> Sink;
+
+  // Parses the sentences of `source` with parse_batch, `window_size` at a
+  // time, and passes each state to `sink` in the order of the input once its
+  // window is parsed. Only one window of sentences and states is kept, so
+  // the memory does not depend on the length of the input.
+  void parse_stream(const Source& source, size_t window_size,
+                    size_t batch_size, const Sink& sink);
+
+  template <typename InputIterator>
+  void parse_stream(InputIterator first, InputIterator last,
+                    size_t window_size, size_t batch_size, const Sink& sink) {
+    parse_stream(
+        [&first, &last](std::vector<Sentence>* window) {
+          if (first == last) return false;
+          window->push_back(*first);
+          ++first;
+          return true;
+        },
+        window_size, batch_size, sink);
+  }
+
  protected:
+  static std::vector<int> sortByLength(const std::vector<Sentence>& sentences);
+
   const std::shared_ptr<Classifier> classifier_;
 
  private:
@@ -34,7 +67,76 @@ class Parser {
 
 class GreedyParser : public Parser {
  public:
-  explicit GreedyParser(std::shared_ptr<Classifier> classifier);
+  // With `continuous`, parse_batch refills the slot of each finished
+  // sentence with a pending one instead of running fixed batches to the end.
+  // With `pipelined`, each fixed batch is split into two halves, and the
+  // features of one half are extracted and its actions applied on a second
+  // thread while the classifier scores the other half. The two modes exclude
+  // each other.
+  explicit GreedyParser(std::shared_ptr<Classifier> classifier,
+                        const unsigned num_threads = 1,
+                        const bool continuous = false,
+                        const bool pipelined = false);
+
+  std::unique_ptr<State> parse(const Sentence& sentence) override;
+
+  std::vector<std::unique_ptr<State>> parse_batch(
+      const std::vector<Sentence>& sentences);
+
+  std::vector<std::unique_ptr<State>> parse_batch(
+      const std::vector<Sentence>& sentences,
+      const size_t batch_size) override;
+
+  // Parses batches on `num_threads` threads sharing the classifier, which
+  // must be thread-safe when more than one thread is used.
+  std::vector<std::unique_ptr<State>> parse_batch(
+      const std::vector<Sentence>& sentences, const size_t batch_size,
+      const unsigned num_threads);
+
+  // `feature` is a kNFeatures-sized buffer reused across steps.
+  Action getNextAction(const State& state, FeatureVector* feature);
+
+  // Applies the best allowed action to each of the non-terminal `states`,
+  // which are scored in one compute_batch call, after their forced SHIFT if
+  // they have one. `features` and `scores` are reused across steps.
+  void advance(const std::vector<State*>& states, FeatureMatrix* features,
+               std::vector<float>* scores);
+
+ private:
+  void parseStates(std::vector<State*>* targets);
+
+  void parseContinuously(const std::vector<std::unique_ptr<State>>& states,
+                         size_t batch_size, std::atomic<size_t>* next_state);
+
+  // Parses the targets in two halves, stepping one on `helper` while the
+  // other is scored on the calling thread.
+  void parsePipelined(std::vector<State*>* targets,
+                      utility::thread::Worker* helper);
+
+  // Applies the forced action of each state that has one, which saves the
+  // classifier a row.
+  static void applyForced(const std::vector<State*>& states);
+
+  // Writes the features of the states to the rows of `features`.
+  static void extract(const std::vector<State*>& states,
+                      FeatureMatrix* features);
+
+  // Applies the best allowed action of each row of `scores` to the state.
+  static void apply(const std::vector<State*>& states,
+                    const std::vector<float>& scores);
+
+  const unsigned num_threads_;
+  const bool continuous_;
+  const bool pipelined_;
+};
+
+// Keeps the `beam_width` best states per sentence, scored by the sum of the
+// log-probabilities of their actions. All live beam items of all sentences in
+// a batch are scored in one compute_batch call per step.
+class BeamParser : public Parser {
+ public:
+  BeamParser(std::shared_ptr<Classifier> classifier,
+             const unsigned beam_width);
 
   std::unique_ptr<State> parse(const Sentence& sentence) override;
 
@@ -42,9 +144,17 @@ class GreedyParser : public Parser {
       const std::vector<Sentence>& sentences);
 
   std::vector<std::unique_ptr<State>> parse_batch(
-      const std::vector<Sentence>& sentences, const size_t batch_size);
+      const std::vector<Sentence>& sentences,
+      const size_t batch_size) override;
+
+  unsigned beamWidth() const;
+
+ private:
+  typedef std::vector<std::unique_ptr<State>> Beam;
+
+  void search(std::vector<Beam>* beams);
 
-  Action getNextAction(const State& state);
+  const unsigned beam_width_;
 };
 
 }  // namespace transitionparser
@@ -0,0 +1,106 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include "transitionparser/prefetcher.h"
+
+#include <algorithm>
+
+namespace transitionparser {
+
+BatchPrefetcher::BatchPrefetcher(const ExampleSource& examples,
+                                 const unsigned num_workers,
+                                 const size_t capacity) :
+    examples_(examples), slots_(std::max<size_t>(capacity, 1)) {
+  for (unsigned i = 0; i < num_workers; ++i) {
+    workers_.emplace_back(&BatchPrefetcher::work, this);
+  }
+}
+
+BatchPrefetcher::~BatchPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  released_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void BatchPrefetcher::start(const tools::BatchIndices& batches,
+                            const size_t first, const size_t step) {
+  TRANSITIONPARSER_ASSERT(step > 0, "step must be positive");
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    TRANSITIONPARSER_ASSERT(num_consumed_ == num_batches_,
+                            "the previous epoch has not been consumed");
+    batches_ = &batches;
+    first_ = first;
+    step_ = step;
+    num_batches_ = first < batches.size()
+        ? (batches.size() - first + step - 1) / step : 0;
+    num_claimed_ = num_consumed_ = num_released_ = 0;
+    for (auto& slot : slots_) {
+      slot.ready = false;
+    }
+  }
+  released_.notify_all();
+}
+
+size_t BatchPrefetcher::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_batches_;
+}
+
+const BatchPrefetcher::Batch& BatchPrefetcher::next() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  TRANSITIONPARSER_ASSERT(num_consumed_ < num_batches_,
+                          "no batch left in the epoch");
+  // the slot returned by the previous call is free again
+  num_released_ = num_consumed_;
+  const size_t index = num_consumed_++;
+  Slot& slot = slots_[index % slots_.size()];
+  if (workers_.empty()) {
+    const tools::BatchIndices::Batch indices = batch(index);
+    examples_.gather(indices.indices, indices.size, &slot.batch.features,
+                     &slot.batch.actions);
+    return slot.batch;
+  }
+  released_.notify_all();
+  filled_.wait(lock, [&slot, index]() {
+    return slot.ready && slot.index == index;
+  });
+  slot.ready = false;
+  return slot.batch;
+}
+
+void BatchPrefetcher::work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    released_.wait(lock, [this]() {
+      return stopped_ || (num_claimed_ < num_batches_
+                          && num_claimed_ < num_released_ + slots_.size());
+    });
+    if (stopped_) {
+      return;
+    }
+    const size_t index = num_claimed_++;
+    const tools::BatchIndices::Batch indices = batch(index);
+    Slot& slot = slots_[index % slots_.size()];
+    lock.unlock();
+    examples_.gather(indices.indices, indices.size, &slot.batch.features,
+                     &slot.batch.actions);
+    lock.lock();
+    slot.index = index;
+    slot.ready = true;
+    filled_.notify_all();
+  }
+}
+
+tools::BatchIndices::Batch BatchPrefetcher::batch(const size_t index) const {
+  return (*batches_)[first_ + index * step_];
+}
+
+}  // namespace transitionparser
@@ -0,0 +1,83 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#ifndef TRANSITIONPARSER_PREFETCHER_H_
+#define TRANSITIONPARSER_PREFETCHER_H_
+
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <mutex>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "transitionparser/dataset.h"
+#include "transitionparser/feature.h"
+#include "transitionparser/tools.h"
+#include "transitionparser/utility.h"
+
+namespace transitionparser {
+
+// Gathers the batches of an epoch on worker threads into a bounded ring of
+// `capacity` slots, so that they are ready by the time the trainer asks for
+// them. Batches are handed out in order regardless of which worker gathered
+// them. With no workers, next() gathers the batch on the calling thread.
+class BatchPrefetcher {
+ public:
+  struct Batch {
+    FeatureMatrix features;
+    std::vector<unsigned> actions;
+  };
+
+  BatchPrefetcher(const ExampleSource& examples, unsigned num_workers,
+                  size_t capacity);
+
+  ~BatchPrefetcher();
+
+  // Starts gathering the batches `first`, `first + step`, ... of an epoch.
+  // The previous epoch must have been consumed, and `batches` must not
+  // change until this one is.
+  void start(const tools::BatchIndices& batches, size_t first = 0,
+             size_t step = 1);
+
+  // Returns the number of batches of the current epoch.
+  size_t size() const;
+
+  // Returns the next batch of the epoch, blocking until it is ready. It
+  // stays valid until the following call to next() or start().
+  const Batch& next();
+
+ private:
+  struct Slot {
+    Batch batch;
+    size_t index;
+    bool ready;
+  };
+
+  void work();
+
+  tools::BatchIndices::Batch batch(size_t index) const;
+
+  const ExampleSource& examples_;
+  std::vector<Slot> slots_;
+  std::vector<std::thread> workers_;
+  mutable std::mutex mutex_;
+  std::condition_variable filled_;
+  std::condition_variable released_;
+
+  // guarded by mutex_
+  const tools::BatchIndices* batches_ = nullptr;
+  size_t first_ = 0;
+  size_t step_ = 1;
+  size_t num_batches_ = 0;
+  size_t num_claimed_ = 0;
+  size_t num_consumed_ = 0;
+  size_t num_released_ = 0;
+  bool stopped_ = false;
+
+  DISALLOW_COPY_AND_MOVE(BatchPrefetcher);
+};
+
+}  // namespace transitionparser
+
+#endif  // TRANSITIONPARSER_PREFETCHER_H_
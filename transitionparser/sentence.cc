@@ -5,13 +5,46 @@
 
 #include "transitionparser/sentence.h"
 
+#include <utility>
 #include <vector>
 
 namespace transitionparser {
 
 Sentence::Sentence(const int id, const std::vector<Token>& tokens) :
     id(id), tokens(tokens),
-    length(static_cast<const unsigned int>(tokens.size())) {}
+    length(static_cast<const unsigned int>(tokens.size())) {
+  index();
+}
+
+Sentence::Sentence(const int id, std::vector<Token>&& tokens) :
+    id(id), tokens(std::move(tokens)),
+    length(static_cast<const unsigned int>(this->tokens.size())) {
+  index();
+}
+
+SentenceView Sentence::view() const {
+  return {id, length, words_.data(), tags_.data(), labels_.data(),
+          heads_.data(), children_.data()};
+}
+
+void Sentence::index() {
+  words_.reserve(length);
+  tags_.reserve(length);
+  labels_.reserve(length);
+  heads_.reserve(length);
+  for (const auto& token : tokens) {
+    words_.push_back(token.word);
+    tags_.push_back(token.tag);
+    labels_.push_back(token.label);
+    heads_.push_back(token.head);
+  }
+  children_.assign(length, 0);
+  for (unsigned i = 1; i < length; ++i) {
+    if (heads_[i] >= 0 && heads_[i] < static_cast<int>(length)) {
+      ++children_[heads_[i]];
+    }
+  }
+}
 
 std::ostream& operator<<(std::ostream& os, const Sentence& sentence) {
   os << utility::vector::join(sentence.tokens, ' ');
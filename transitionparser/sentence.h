@@ -13,18 +13,44 @@
 
 namespace transitionparser {
 
+// Read-only view of the ids of a sentence whose storage is owned elsewhere,
+// either by a Sentence or by a Corpus. Index 0 is the root.
+struct SentenceView {
+  int id;
+  unsigned length;
+  const unsigned* words;
+  const unsigned* tags;
+  const unsigned* labels;
+  const int* heads;
+  // number of gold dependents of each token
+  const unsigned* children;
+};
+
 struct Sentence {
  public:
   Sentence() = delete;
   Sentence(const int id, const std::vector<Token>& tokens);
+  Sentence(const int id, std::vector<Token>&& tokens);
   DEFAULT_COPY_AND_MOVE(Sentence);
   ~Sentence() {}
 
   friend std::ostream& operator<<(std::ostream& os, const Sentence& sentence);
 
+  SentenceView view() const;
+
   const int id;
   const std::vector<Token> tokens;
   const unsigned length;
+
+ private:
+  void index();
+
+  // ids of the tokens, kept contiguous for SentenceView
+  std::vector<unsigned> words_;
+  std::vector<unsigned> tags_;
+  std::vector<unsigned> labels_;
+  std::vector<int> heads_;
+  std::vector<unsigned> children_;
 };
 
 }  // namespace transitionparser
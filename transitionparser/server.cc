@@ -0,0 +1,496 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include "transitionparser/server.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <future>  // NOLINT(build/c++11)
+#include <utility>
+
+#include "transitionparser/feature.h"
+#include "transitionparser/logger.h"
+#include "transitionparser/tools.h"
+#include "transitionparser/transition.h"
+
+namespace transitionparser {
+
+namespace {
+
+sockaddr_un socket_address(const std::string& socket_path) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    TRANSITIONPARSER_EXCEPTION("socket path '{}' is too long.", socket_path);
+  }
+  std::strncpy(address.sun_path, socket_path.c_str(),
+               sizeof(address.sun_path) - 1);
+  return address;
+}
+
+// Writes the whole buffer; returns false once the peer has gone.
+bool send_all(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+// Reads the lines of a socket through a buffer of at most `max_length`
+// bytes plus one chunk.
+class LineReader {
+ public:
+  LineReader(int fd, size_t max_length) : fd_(fd), max_length_(max_length) {}
+
+  // Returns false at the end of the stream. A line of more than `max_length`
+  // bytes is skipped up to its line break without being kept, and reported
+  // through `too_long` with an empty `line`.
+  bool getline(std::string* line, bool* too_long) {
+    *too_long = false;
+    while (true) {
+      const char* begin = buffer_.data() + position_;
+      const char* end = buffer_.data() + buffer_.size();
+      const char* eol = static_cast<const char*>(
+          std::memchr(begin, '\n', end - begin));
+      if (eol != nullptr) {
+        *too_long = *too_long || static_cast<size_t>(eol - begin) > max_length_;
+        if (*too_long) {
+          line->clear();
+        } else {
+          line->assign(begin, eol);
+        }
+        position_ = eol + 1 - buffer_.data();
+        return true;
+      }
+      if (*too_long || static_cast<size_t>(end - begin) > max_length_) {
+        *too_long = true;
+        buffer_.clear();
+      } else {
+        buffer_.erase(0, position_);
+      }
+      position_ = 0;
+      char chunk[4096];
+      ssize_t received = ::recv(fd_, chunk, sizeof(chunk), 0);
+      if (received < 0 && errno == EINTR) continue;
+      if (received <= 0) {
+        if (*too_long) {
+          line->clear();
+          return true;
+        }
+        // the last line may lack its line break
+        line->swap(buffer_);
+        buffer_.clear();
+        return !line->empty();
+      }
+      buffer_.append(chunk, received);
+    }
+  }
+
+ private:
+  const int fd_;
+  const size_t max_length_;
+  std::string buffer_;
+  size_t position_ = 0;
+};
+
+}  // namespace
+
+BatchingParser::Request::Request(Sentence&& sentence, Callback&& done,
+                                 ErrorCallback&& failed) :
+    sentence(std::move(sentence)), state(this->sentence),
+    done(std::move(done)), failed(std::move(failed)), arrival(clock::now()) {}
+
+BatchingParser::BatchingParser(std::shared_ptr<Classifier> classifier,
+                               const size_t max_batch_size,
+                               const std::chrono::microseconds max_wait) :
+    parser_(classifier), max_batch_size_(std::max<size_t>(max_batch_size, 1)),
+    max_wait_(max_wait), num_steps_(0), num_scored_(0) {
+  scheduler_ = std::thread(&BatchingParser::run, this);
+}
+
+BatchingParser::~BatchingParser() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  arrived_.notify_all();
+  scheduler_.join();
+}
+
+void BatchingParser::submit(Sentence sentence, Callback done,
+                            ErrorCallback failed) {
+  auto request = std::make_unique<Request>(
+      std::move(sentence), std::move(done), std::move(failed));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    TRANSITIONPARSER_ASSERT(!stopped_, "the parser has been stopped");
+    pending_.push_back(std::move(request));
+  }
+  arrived_.notify_one();
+}
+
+double BatchingParser::meanBatchSize() const {
+  const size_t num_steps = num_steps_;
+  return num_steps > 0 ? static_cast<double>(num_scored_) / num_steps : 0.0;
+}
+
+void BatchingParser::run() {
+  std::vector<std::unique_ptr<Request>> active;
+  std::vector<State*> states;
+  // the matrix and the scores keep their capacity across steps
+  FeatureMatrix features;
+  std::vector<float> scores;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (active.empty()) {
+        arrived_.wait(lock, [this]() { return !pending_.empty() || stopped_; });
+        if (pending_.empty()) break;
+        const clock::time_point deadline = pending_.front()->arrival
+            + max_wait_;
+        arrived_.wait_until(lock, deadline, [this]() {
+          return pending_.size() >= max_batch_size_ || stopped_;
+        });
+      }
+      while (!pending_.empty() && active.size() < max_batch_size_) {
+        active.push_back(std::move(pending_.front()));
+        pending_.pop_front();
+      }
+    }
+
+    // hand back the terminal states, keeping the others in order
+    size_t num_active = 0;
+    for (auto& request : active) {
+      if (Transition::isTerminal(request->state)) {
+        try {
+          request->done(request->state);
+        } catch (const std::exception& e) {
+          fail(request.get(), e.what());
+        }
+      } else {
+        active[num_active++] = std::move(request);
+      }
+    }
+    active.resize(num_active);
+    if (active.empty()) continue;
+
+    states.clear();
+    for (const auto& request : active) {
+      states.push_back(&request->state);
+    }
+    try {
+      parser_.advance(states, &features, &scores);
+    } catch (const std::exception& e) {
+      for (auto& request : active) {
+        fail(request.get(), e.what());
+      }
+      active.clear();
+      continue;
+    }
+    ++num_steps_;
+    num_scored_ += states.size();
+  }
+}
+
+void BatchingParser::fail(Request* request, const std::string& error) {
+  try {
+    request->failed(error);
+  } catch (const std::exception& e) {
+    log::warning("cannot report '{}' for sentence {}: {}", error,
+                 request->sentence.id, e.what());
+  }
+}
+
+const size_t ParseServer::kMaxLineLength = 1 << 16;
+const size_t ParseServer::kMaxTokens = 1024;
+const size_t ParseServer::kMaxPendingReplies = 64;
+
+ParseServer::ParseServer(std::shared_ptr<Classifier> classifier,
+                         const std::string& socket_path,
+                         const size_t max_batch_size,
+                         const std::chrono::microseconds max_wait) :
+    socket_path_(socket_path),
+    parser_(classifier, max_batch_size, max_wait) {
+  sockaddr_un address = socket_address(socket_path);
+  // a socket left behind by a previous server is replaced
+  struct stat st;
+  if (stat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    ::unlink(socket_path.c_str());
+  }
+  listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0
+      || ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&address),
+                sizeof(address)) != 0
+      || ::listen(listen_fd_, SOMAXCONN) != 0) {
+    const std::string error = std::strerror(errno);
+    if (listen_fd_ >= 0) ::close(listen_fd_);
+    TRANSITIONPARSER_EXCEPTION("cannot listen on '{}': {}.", socket_path,
+                               error);
+  }
+  acceptor_ = std::thread(&ParseServer::accept, this);
+}
+
+ParseServer::~ParseServer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+    for (int fd : connections_) {
+      ::shutdown(fd, SHUT_RDWR);
+    }
+  }
+  ::shutdown(listen_fd_, SHUT_RDWR);
+  acceptor_.join();
+  ::close(listen_fd_);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    closed_.wait(lock, [this]() { return connections_.empty(); });
+  }
+  ::unlink(socket_path_.c_str());
+}
+
+double ParseServer::meanBatchSize() const {
+  return parser_.meanBatchSize();
+}
+
+void ParseServer::accept() {
+  while (true) {
+    int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+      if (fd >= 0) ::close(fd);
+      break;
+    }
+    if (fd < 0) {
+      if (errno != EINTR && errno != ECONNABORTED) {
+        log::warning("cannot accept a connection: {}", std::strerror(errno));
+      }
+      continue;
+    }
+    connections_.push_back(fd);
+    std::thread(&ParseServer::serve, this, fd).detach();
+  }
+}
+
+void ParseServer::serve(int fd) {
+  struct Job {
+    std::vector<std::string> lines;
+    std::promise<std::string> reply;
+  };
+
+  // the replies are written in the order of the sentences
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<std::future<std::string>> replies;
+  bool closed = false;
+  std::thread writer([&]() {
+    bool connected = true;
+    while (true) {
+      std::future<std::string> reply;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [&]() { return !replies.empty() || closed; });
+        if (replies.empty()) break;
+        reply = std::move(replies.front());
+        replies.pop_front();
+      }
+      ready.notify_all();
+      const std::string text = reply.get();
+      connected = connected && send_all(fd, text.data(), text.size());
+    }
+  });
+
+  LineReader reader(fd, kMaxLineLength);
+  std::string line;
+  auto job = std::make_shared<Job>();
+  int count = 0;
+  // a client that does not read its replies stalls the reader, and then
+  // its own writes, instead of growing the queue
+  auto enqueue = [&](std::future<std::string> reply) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      ready.wait(lock, [&]() {
+        return replies.size() < kMaxPendingReplies;
+      });
+      replies.push_back(std::move(reply));
+    }
+    ready.notify_all();
+    job = std::make_shared<Job>();
+  };
+  auto submit = [&]() {
+    std::future<std::string> reply = job->reply.get_future();
+    try {
+      std::vector<Token> tokens;
+      tokens.reserve(job->lines.size() + 1);
+      tokens.push_back(Token::createRoot());
+      Token::Fields fields;
+      for (const auto& token_line : job->lines) {
+        tools::split_fields(token_line.data(),
+                            token_line.data() + token_line.size(), &fields);
+        tokens.emplace_back(fields);
+      }
+      parser_.submit(Sentence(++count, std::move(tokens)),
+                     [job](const State& state) {
+                       std::string text;
+                       tools::write_conll(state, job->lines.data(), &text);
+                       job->reply.set_value(std::move(text));
+                     },
+                     [job](const std::string& error) {
+                       job->reply.set_value(utility::string::format(
+                           "# error: {}\n\n", error));
+                     });
+    } catch (const std::exception& e) {
+      job->reply.set_value(utility::string::format("# error: {}\n\n",
+                                                   e.what()));
+    }
+    enqueue(std::move(reply));
+  };
+  // an oversized sentence is answered with an error as soon as it is seen,
+  // and its remaining lines are dropped up to the blank line
+  bool dropping = false;
+  auto reject = [&](const std::string& error) {
+    std::future<std::string> reply = job->reply.get_future();
+    job->reply.set_value(utility::string::format("# error: {}\n\n", error));
+    enqueue(std::move(reply));
+    dropping = true;
+  };
+  bool too_long;
+  while (reader.getline(&line, &too_long)) {
+    utility::string::trim(line);
+    if (too_long) {
+      if (!dropping) {
+        reject(utility::string::format("a line exceeds {} bytes.",
+                                       kMaxLineLength));
+      }
+    } else if (line.empty()) {
+      if (dropping) {
+        dropping = false;
+      } else if (!job->lines.empty()) {
+        submit();
+      }
+    } else if (dropping) {
+      continue;
+    } else if (job->lines.size() == kMaxTokens) {
+      reject(utility::string::format("a sentence exceeds {} tokens.",
+                                     kMaxTokens));
+    } else {
+      job->lines.push_back(std::move(line));
+    }
+  }
+  if (!dropping && !job->lines.empty()) {
+    submit();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+  }
+  ready.notify_all();
+  writer.join();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  connections_.erase(
+      std::find(connections_.begin(), connections_.end(), fd));
+  ::close(fd);
+  closed_.notify_all();
+}
+
+ParseClient::ParseClient(const std::string& socket_path) {
+  sockaddr_un address = socket_address(socket_path);
+  fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd_ < 0
+      || ::connect(fd_, reinterpret_cast<sockaddr*>(&address),
+                   sizeof(address)) != 0) {
+    const std::string error = std::strerror(errno);
+    if (fd_ >= 0) ::close(fd_);
+    TRANSITIONPARSER_EXCEPTION("cannot connect to '{}': {}.", socket_path,
+                               error);
+  }
+}
+
+ParseClient::~ParseClient() {
+  ::close(fd_);
+}
+
+std::string ParseClient::parse(const std::string& sentence) {
+  // an empty sentence would never be answered
+  TRANSITIONPARSER_ASSERT(
+      sentence.find_first_not_of(" \t\r\n") != std::string::npos,
+      "cannot send an empty sentence");
+  std::string request = sentence;
+  if (request.empty() || request.back() != '\n') request.push_back('\n');
+  request.push_back('\n');
+  if (!send_all(fd_, request.data(), request.size())) {
+    TRANSITIONPARSER_EXCEPTION("the server has closed the connection.");
+  }
+  // a reply ends with a blank line
+  size_t end;
+  while ((end = buffer_.find("\n\n")) == std::string::npos) {
+    char chunk[4096];
+    ssize_t received = ::recv(fd_, chunk, sizeof(chunk), 0);
+    if (received < 0 && errno == EINTR) continue;
+    if (received <= 0) {
+      TRANSITIONPARSER_EXCEPTION("the server has closed the connection.");
+    }
+    buffer_.append(chunk, received);
+  }
+  std::string reply = buffer_.substr(0, end + 1);
+  buffer_.erase(0, end + 2);
+  return reply;
+}
+
+LoadReport generate_load(const std::string& socket_path,
+                         const std::vector<std::string>& sentences,
+                         const unsigned num_clients,
+                         const size_t num_requests) {
+  typedef std::chrono::steady_clock clock;
+  TRANSITIONPARSER_ASSERT(!sentences.empty() && num_clients > 0,
+                          "no sentence or no client to send it");
+  std::vector<std::vector<double>> latencies(num_clients);
+  std::vector<std::thread> clients;
+  auto start = clock::now();
+  for (unsigned k = 0; k < num_clients; ++k) {
+    clients.emplace_back([&, k]() {
+      ParseClient client(socket_path);
+      for (size_t i = k; i < num_requests; i += num_clients) {
+        auto sent = clock::now();
+        client.parse(sentences[i % sentences.size()]);
+        latencies[k].push_back(std::chrono::duration<double, std::milli>(
+            clock::now() - sent).count());
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  LoadReport report;
+  report.num_requests = num_requests;
+  report.seconds = std::chrono::duration<double>(clock::now() - start).count();
+  std::vector<double> all;
+  for (const auto& client_latencies : latencies) {
+    all.insert(all.end(), client_latencies.begin(), client_latencies.end());
+  }
+  std::sort(all.begin(), all.end());
+  auto percentile = [&all](double p) {
+    return all.empty() ? 0.0 : all[std::min<size_t>(all.size() - 1,
+                                                    all.size() * p)];
+  };
+  report.p50_ms = percentile(0.50);
+  report.p99_ms = percentile(0.99);
+  return report;
+}
+
+}  // namespace transitionparser
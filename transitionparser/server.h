@@ -0,0 +1,169 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#ifndef TRANSITIONPARSER_SERVER_H_
+#define TRANSITIONPARSER_SERVER_H_
+
+#include <atomic>
+#include <chrono>  // NOLINT(build/c++11)
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "transitionparser/parser.h"
+#include "transitionparser/sentence.h"
+#include "transitionparser/state.h"
+#include "transitionparser/utility.h"
+
+namespace transitionparser {
+
+// Parses sentences submitted from many threads on one scheduler thread,
+// which merges the live states of all of them into shared classifier
+// batches. A sentence joins the batch at the next step after it arrives and
+// leaves it as soon as it is terminal, so short sentences do not wait for
+// long ones. When no sentence is being parsed, the first arrival waits up
+// to `max_wait` for others to fill the batch. A step that throws fails the
+// sentences of the batch, and the parser goes on with the next arrivals.
+class BatchingParser {
+ public:
+  // Called on the scheduler thread with the terminal state of a sentence;
+  // it should return quickly since the whole batch waits for it.
+  typedef std::function<void(const State&)> Callback;
+
+  // Called on the scheduler thread, instead of the callback or after it
+  // threw, with the error that failed the sentence.
+  typedef std::function<void(const std::string&)> ErrorCallback;
+
+  BatchingParser(std::shared_ptr<Classifier> classifier,
+                 size_t max_batch_size, std::chrono::microseconds max_wait);
+
+  // Finishes the submitted sentences before returning.
+  ~BatchingParser();
+
+  void submit(Sentence sentence, Callback done, ErrorCallback failed);
+
+  // Returns the mean number of states scored per classifier call.
+  double meanBatchSize() const;
+
+ private:
+  typedef std::chrono::steady_clock clock;
+
+  struct Request {
+    Request(Sentence&& sentence, Callback&& done, ErrorCallback&& failed);
+
+    const Sentence sentence;
+    State state;
+    Callback done;
+    ErrorCallback failed;
+    clock::time_point arrival;
+  };
+
+  void run();
+
+  static void fail(Request* request, const std::string& error);
+
+  GreedyParser parser_;
+  const size_t max_batch_size_;
+  const std::chrono::microseconds max_wait_;
+
+  std::mutex mutex_;
+  std::condition_variable arrived_;
+  // guarded by mutex_
+  std::deque<std::unique_ptr<Request>> pending_;
+  bool stopped_ = false;
+
+  std::atomic<size_t> num_steps_;
+  std::atomic<size_t> num_scored_;
+  std::thread scheduler_;
+
+  DISALLOW_COPY_AND_MOVE(BatchingParser);
+};
+
+// Serves a BatchingParser on a Unix domain socket. A client writes CoNLL
+// sentences, each followed by a blank line, and reads each of them back in
+// the same order with the predicted HEAD and DEPREL columns, followed by a
+// blank line. Each connection is read on its own thread and the replies are
+// written by a second one as soon as they are ready. The dictionaries must
+// be fixed, as after ModelBundle::loadDictionaries, so that the connection
+// threads only read them. A sentence with a line of more than
+// kMaxLineLength bytes or more than kMaxTokens tokens is answered with an
+// "# error:" line and dropped, and a connection stops reading while
+// kMaxPendingReplies of its replies are waiting to be sent, so that no
+// client can make the server hold an unbounded input.
+class ParseServer {
+ public:
+  static const size_t kMaxLineLength;
+  static const size_t kMaxTokens;
+  static const size_t kMaxPendingReplies;
+
+  ParseServer(std::shared_ptr<Classifier> classifier,
+              const std::string& socket_path, size_t max_batch_size,
+              std::chrono::microseconds max_wait);
+
+  // Stops accepting, closes the connections and removes the socket.
+  ~ParseServer();
+
+  double meanBatchSize() const;
+
+ private:
+  void accept();
+
+  void serve(int fd);
+
+  const std::string socket_path_;
+  int listen_fd_ = -1;
+  BatchingParser parser_;
+
+  std::mutex mutex_;
+  std::condition_variable closed_;
+  // guarded by mutex_
+  std::vector<int> connections_;
+  bool stopped_ = false;
+
+  std::thread acceptor_;
+
+  DISALLOW_COPY_AND_MOVE(ParseServer);
+};
+
+// Sends one sentence at a time to a ParseServer and waits for its reply.
+class ParseClient {
+ public:
+  explicit ParseClient(const std::string& socket_path);
+
+  ~ParseClient();
+
+  // Sends the lines of a CoNLL sentence, without the blank line, and
+  // returns the parsed lines in the same form.
+  std::string parse(const std::string& sentence);
+
+ private:
+  int fd_ = -1;
+  std::string buffer_;
+
+  DISALLOW_COPY_AND_MOVE(ParseClient);
+};
+
+struct LoadReport {
+  size_t num_requests;
+  double seconds;
+  double p50_ms;
+  double p99_ms;
+};
+
+// Sends `num_requests` sentences, taken in turn from `sentences`, from
+// `num_clients` concurrent clients that each wait for a reply before the
+// next request, and reports the throughput and the latency percentiles.
+LoadReport generate_load(const std::string& socket_path,
+                         const std::vector<std::string>& sentences,
+                         unsigned num_clients, size_t num_requests);
+
+}  // namespace transitionparser
+
+#endif  // TRANSITIONPARSER_SERVER_H_
@@ -0,0 +1,67 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#include "transitionparser/shared_parameters.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace transitionparser {
+
+namespace {
+
+// every tensor starts on a cache line of its own
+const size_t kAlignment = 64 / sizeof(float);
+
+size_t align(size_t size) {
+  return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+}  // namespace
+
+SharedParameters::SharedParameters(dynet::ParameterCollection* model) {
+  for (const auto& p : model->parameters_list()) {
+    size_ += align(p->values.d.size());
+  }
+  for (const auto& p : model->lookup_parameters_list()) {
+    size_ += align(p->all_values.d.size());
+  }
+  mapping_size_ = std::max<size_t>(size_, 1) * sizeof(float);
+  void* addr = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    TRANSITIONPARSER_EXCEPTION("cannot map {} bytes of shared memory.",
+                               mapping_size_);
+  }
+  mapping_ = static_cast<char*>(addr);
+
+  // the tensors keep their shapes and only point to the shared copies; the
+  // gradients are left where DyNet allocated them
+  float* shared = reinterpret_cast<float*>(mapping_);
+  for (const auto& p : model->parameters_list()) {
+    const size_t size = p->values.d.size();
+    std::memcpy(shared, p->values.v, size * sizeof(float));
+    p->values.v = shared;
+    shared += align(size);
+  }
+  for (const auto& p : model->lookup_parameters_list()) {
+    const size_t size = p->all_values.d.size();
+    std::memcpy(shared, p->all_values.v, size * sizeof(float));
+    p->all_values.v = shared;
+    const size_t row_size = p->dim.size();
+    for (size_t row = 0; row < p->values.size(); ++row) {
+      p->values[row].v = shared + row * row_size;
+    }
+    shared += align(size);
+  }
+}
+
+SharedParameters::~SharedParameters() {
+  munmap(mapping_, mapping_size_);
+}
+
+}  // namespace transitionparser
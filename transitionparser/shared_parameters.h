@@ -0,0 +1,43 @@
+//
+// Created by h.teranishi <teranishihiroki@gmail.com>
+// Copyright (c) 2017 Hiroki Teranishi. All rights reserved.
+//
+
+#ifndef TRANSITIONPARSER_SHARED_PARAMETERS_H_
+#define TRANSITIONPARSER_SHARED_PARAMETERS_H_
+
+#include <dynet/dynet.h>
+
+#include <cstddef>
+
+#include "transitionparser/utility.h"
+
+namespace transitionparser {
+
+// Moves the weights of a model into an anonymous shared mapping, so that the
+// processes forked afterwards update one copy of them without locks
+// (Hogwild). The gradients stay in DyNet's parameter pool, which is private
+// to each process, so a worker only ever applies its own gradients. The
+// instance must outlive every use of the model.
+class SharedParameters {
+ public:
+  explicit SharedParameters(dynet::ParameterCollection* model);
+
+  ~SharedParameters();
+
+  // Returns the number of floats in the mapping.
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  size_t size_ = 0;
+  size_t mapping_size_ = 0;
+  char* mapping_ = nullptr;
+
+  DISALLOW_COPY_AND_MOVE(SharedParameters);
+};
+
+}  // namespace transitionparser
+
+#endif  // TRANSITIONPARSER_SHARED_PARAMETERS_H_
@@ -7,13 +7,19 @@
 
 namespace transitionparser {
 
-State::State(const Sentence& sentence) :
-    sentence_(&sentence),
+State::State(const Sentence& sentence) : State(sentence.view()) {
+  source_ = &sentence;
+}
+
+State::State(const SentenceView& sentence) :
+    source_(nullptr),
+    sentence_(sentence),
     num_tokens_(sentence.length),
     stack_{0},
     buffer_(1),
     heads_(num_tokens_, 0),
-    labels_(num_tokens_, 0) {
+    labels_(num_tokens_, 0),
+    children_(num_tokens_, Children{0, {-1, -1}, {-1, -1}}) {
   stack_.reserve(num_tokens_);
 }
 
@@ -23,24 +29,35 @@ State::State(const State& prev_state,
              const int buffer,
              const std::vector<int>& heads,
              const std::vector<int>& labels) :
+    source_(prev_state.source_),
     sentence_(prev_state.sentence_),
     num_tokens_(prev_state.num_tokens_),
     stack_(stack),
     buffer_(buffer),
     heads_(heads),
     labels_(labels),
+    children_(prev_state.children_),
+    score_(prev_state.score_),
     history_(prev_state.history_.begin(), prev_state.history_.end()) {
   TRANSITIONPARSER_ASSERT(buffer_ <= num_tokens_, "buffer exceeds num_tokens.");
   history_.push_back(action);
 }
 
 std::ostream& operator<<(std::ostream& os, const State& state) {
+  const Action prev_action = state.step() > 0 ? state.history_.back() : -1;
+  if (state.source_ == nullptr) {
+    os << utility::string::format("step={}, s0: {}, s1: {}, b0: {}, b1: {}, "
+                                      "prev_action: {}",
+                                  state.step(), state.stack(0), state.stack(1),
+                                  state.buffer(0), state.buffer(1),
+                                  prev_action);
+    return os;
+  }
   const Token& pad = Token::createPad();
   const Token& s0 = state.getToken(state.stack(0), pad);
   const Token& s1 = state.getToken(state.stack(1), pad);
   const Token& b0 = state.getToken(state.buffer(0), pad);
   const Token& b1 = state.getToken(state.buffer(1), pad);
-  const Action prev_action = state.step() > 0 ? state.history_.back() : -1;
   os << utility::string::format("step={}, s0: {}, s1: {}, b0: {}, b1: {}, "
                                     "prev_action: {}",
                                 state.step(), s0, s1, b0, b1, prev_action);
@@ -64,6 +81,27 @@ int State::pop() {
 void State::addArc(int index, int head, int label) {
   heads_[index] = head;
   labels_[index] = label;
+  // arc-standard attaches children outward, so the new child normally
+  // becomes the outermost one; the comparisons keep any order correct
+  Children& children = children_[head];
+  ++children.count;
+  if (index < head) {
+    int* left = children.left;
+    if (left[0] == -1 || index < left[0]) {
+      left[1] = left[0];
+      left[0] = index;
+    } else if (left[1] == -1 || index < left[1]) {
+      left[1] = index;
+    }
+  } else {
+    int* right = children.right;
+    if (right[0] == -1 || index > right[0]) {
+      right[1] = right[0];
+      right[0] = index;
+    } else if (right[1] == -1 || index > right[1]) {
+      right[1] = index;
+    }
+  }
 }
 
 void State::record(Action action) {
@@ -92,6 +130,10 @@ int State::stack(int position) const {
   return index < 0 ? -1 : stack_[index];
 }
 
+const std::vector<int>& State::stack() const {
+  return stack_;
+}
+
 int State::stackSize() const {
   return stack_.size();
 }
@@ -126,41 +168,45 @@ const std::vector<int>& State::labels() const {
   return labels_;
 }
 
-int State::leftmost(int index, int from) const {
-  if (index >=0 && index < num_tokens_ && from >= 0 && from < index) {
-    for (int i = from; i < index; i++) {
-      if (heads_[i] == index) {
-        return i;
-      }
-    }
-  }
-  return -1;
+int State::leftmost(int index, int nth) const {
+  if (index < 0 || index >= num_tokens_ || nth < 1 || nth > 2) return -1;
+  return children_[index].left[nth - 1];
 }
 
-int State::rightmost(int index, int from) const {
-  from = from == -1 ? num_tokens_ - 1 : from;
-  if (index >= 0 && index < num_tokens_
-      && from > index && from < num_tokens_) {
-    for (int i = from; i > index; i--) {
-      if (heads_[i] == index) {
-        return i;
-      }
-    }
-  }
-  return -1;
+int State::rightmost(int index, int nth) const {
+  if (index < 0 || index >= num_tokens_ || nth < 1 || nth > 2) return -1;
+  return children_[index].right[nth - 1];
+}
+
+int State::numChildren(int index) const {
+  return children_[index].count;
+}
+
+const SentenceView& State::sentence() const {
+  return sentence_;
 }
 
 const Token& State::getToken(int index) const {
-  return sentence_->tokens.at(index);
+  TRANSITIONPARSER_ASSERT(source_ != nullptr, "the state has no tokens.");
+  return source_->tokens.at(index);
 }
 
 const Token& State::getToken(int index, const Token& default_token) const {
   if (index < 0 || index >= num_tokens_) return default_token;
-  return sentence_->tokens[index];
+  TRANSITIONPARSER_ASSERT(source_ != nullptr, "the state has no tokens.");
+  return source_->tokens[index];
 }
 
 const std::vector<Action>& State::history() const {
   return history_;
 }
 
+double State::score() const {
+  return score_;
+}
+
+void State::setScore(double score) {
+  score_ = score;
+}
+
 }  // namespace transitionparser
@@ -26,6 +26,8 @@ class State {
 
   explicit State(const Sentence& sentence);
 
+  explicit State(const SentenceView& sentence);
+
   State(const State& prev_state,
         const Action& action,
         const std::vector<int>& stack,
@@ -67,6 +69,8 @@ class State {
 
   int stack(int position) const;
 
+  const std::vector<int>& stack() const;
+
   int stackSize() const;
 
   bool stackEmpty() const;
@@ -83,23 +87,46 @@ class State {
 
   const std::vector<int>& labels() const;
 
-  int leftmost(int index, int from = 0) const;
+  // Returns the leftmost (nth = 1) or the second leftmost (nth = 2) child
+  // attached to the token so far, or -1 if there is none. Constant time.
+  int leftmost(int index, int nth = 1) const;
+
+  // Returns the rightmost (nth = 1) or the second rightmost (nth = 2) child
+  // attached to the token so far, or -1 if there is none. Constant time.
+  int rightmost(int index, int nth = 1) const;
 
-  int rightmost(int index, int from = -1) const;
+  // Returns the number of children attached to the token so far.
+  int numChildren(int index) const;
 
+  const SentenceView& sentence() const;
+
+  // Tokens are available only for states created from a Sentence.
   const Token& getToken(int index) const;
 
   const Token& getToken(int index, const Token& default_token) const;
 
   const std::vector<Action>& history() const;
 
+  double score() const;
+
+  void setScore(double score);
+
  private:
-  const Sentence* sentence_;
+  const Sentence* source_;
+  SentenceView sentence_;
   const int num_tokens_;
   std::vector<int> stack_;
   int buffer_;
   std::vector<int> heads_;
   std::vector<int> labels_;
+  // the number of children and the two outermost children on each side of
+  // every token, kept up to date by addArc; -1 means no child
+  struct Children {
+    int count;
+    int left[2];
+    int right[2];
+  };
+  std::vector<Children> children_;
   double score_ = 0.0;
   std::vector<Action> history_;
 
@@ -5,13 +5,44 @@
 
 #include "transitionparser/token.h"
 
+#include <string>
+
+#include "transitionparser/utility.h"
+
 namespace transitionparser {
 
+namespace {
+
+// Parses a leading (optionally negative) integer like std::stoi.
+int to_int(const boost::string_ref& value) {
+  auto it = value.begin();
+  bool negative = it != value.end() && *it == '-';
+  if (negative) ++it;
+  int result = 0;
+  for (; it != value.end() && *it >= '0' && *it <= '9'; ++it) {
+    result = result * 10 + (*it - '0');
+  }
+  return negative ? -result : result;
+}
+
+}  // namespace
+
 // cppcheck-suppress uninitMemberVar
 Token::Token(const std::vector<string>& attributes)
     : Token(std::stoi(attributes[0]), attributes[1], attributes[4],
             std::stoi(attributes[6]), attributes[7]) {}
 
+// cppcheck-suppress uninitMemberVar
+Token::Token(const Fields& fields)
+    : id(to_int(fields[ID])),
+      form(fields[FORM].data(), fields[FORM].size()),
+      postag(fields[POSTAG].data(), fields[POSTAG].size()),
+      head(to_int(fields[HEAD])),
+      deprel(fields[DEPREL].data(), fields[DEPREL].size()),
+      word(convert(Token::Attribute::FORM, fields[FORM])),
+      tag(convert(Token::Attribute::POSTAG, fields[POSTAG])),
+      label(convert(Token::Attribute::DEPREL, fields[DEPREL])) {}
+
 // cppcheck-suppress uninitMemberVar
 Token::Token(const string& id, const string& form, const string& lemma,
              const string& cpostag, const string& postag, const string& feats,
@@ -87,10 +118,57 @@ Token::Token(const int& id, const string& form, const string& postag,
       tag(convert(Token::Attribute::POSTAG, postag)),
       label(convert(Token::Attribute::DEPREL, deprel)) {}
 
+void Token::saveDictionaries(std::ostream& os) {
+  for (Attribute name : {FORM, POSTAG, DEPREL}) {
+    const Dict& dict = attribute_dicts_[name];
+    os << dict.size() << '\n';
+    for (size_t id = 0; id < dict.size(); ++id) {
+      os << dict.lookup(static_cast<int>(id)) << '\n';
+    }
+  }
+}
+
+void Token::loadDictionaries(std::istream& is) {
+  for (Attribute name : {FORM, POSTAG, DEPREL}) {
+    Dict& dict = attribute_dicts_[name];
+    dict = Dict();
+    std::string line;
+    if (!std::getline(is, line)) {
+      TRANSITIONPARSER_EXCEPTION("missing dictionary {}",
+                                 static_cast<int>(name));
+    }
+    const size_t size = std::stoul(line);
+    for (size_t id = 0; id < size; ++id) {
+      if (!std::getline(is, line)) {
+        TRANSITIONPARSER_EXCEPTION("truncated dictionary {}",
+                                   static_cast<int>(name));
+      }
+      dict.lookup(line);
+    }
+  }
+  fixDictionaries();
+}
+
+Token::Ids Token::lookup(const Fields& fields) {
+  return {static_cast<unsigned>(convert(Attribute::FORM, fields[FORM])),
+          static_cast<unsigned>(convert(Attribute::POSTAG, fields[POSTAG])),
+          static_cast<unsigned>(convert(Attribute::DEPREL, fields[DEPREL])),
+          to_int(fields[HEAD])};
+}
+
+Token::Ids Token::ids() const {
+  return {word, tag, label, head};
+}
+
 int Token::convert(const Token::Attribute name, const string& value) {
   return attribute_dicts_[name].lookup(value);
 }
 
+int Token::convert(const Token::Attribute name,
+                   const boost::string_ref& value) {
+  return attribute_dicts_[name].lookup(value.data(), value.size());
+}
+
 std::string Token::convert(const Token::Attribute name, const int index) {
   return attribute_dicts_[name].lookup(index);
 }
@@ -6,6 +6,9 @@
 #ifndef TRANSITIONPARSER_TOKEN_H_
 #define TRANSITIONPARSER_TOKEN_H_
 
+#include <boost/utility/string_ref.hpp>
+
+#include <array>
 #include <iostream>
 #include <string>
 #include <unordered_map>
@@ -46,6 +49,13 @@ struct Token {
         return i->second;
       }
     }
+    // Same as lookup(const std::string&) but reuses a per-thread key buffer,
+    // so that interning a field of a larger text does not allocate.
+    inline int lookup(const char* data, size_t size) {
+      static thread_local std::string key;
+      key.assign(data, size);
+      return lookup(key);
+    }
     inline const std::string& lookup(const int& id) const {
       return words_.at(id);
     }
@@ -74,8 +84,20 @@ struct Token {
     std::unordered_map<std::string, int> d_;
   };
 
+  // The ten columns of a CoNLL line, referring to the text being read.
+  typedef std::array<boost::string_ref, 10> Fields;
+
+  // The ids of a token that are used by the parser.
+  struct Ids {
+    unsigned word;
+    unsigned tag;
+    unsigned label;
+    int head;
+  };
+
   Token() = delete;
   explicit Token(const std::vector<string>& attributes);
+  explicit Token(const Fields& fields);
   Token(const string& id, const string& form, const string& lemma,
         const string& cpostag, const string& postag, const string& feats,
         const string& head, const string& deprel, const string& phead,
@@ -96,6 +118,18 @@ struct Token {
 
   static void fixDictionaries();
 
+  // Writes the dictionaries as text, one entry per line in id order.
+  static void saveDictionaries(std::ostream& os);
+
+  // Replaces the dictionaries with the ones written by saveDictionaries and
+  // fixes them. Must be called before any token is created.
+  static void loadDictionaries(std::istream& is);
+
+  // Interns the columns like Token(fields) without building a token.
+  static Ids lookup(const Fields& fields);
+
+  Ids ids() const;
+
   const int id;
   const std::string form;
   // const int lemma;
@@ -117,6 +151,9 @@ struct Token {
 
   static inline int convert(const Attribute name, const string& value);
 
+  static inline int convert(const Attribute name,
+                            const boost::string_ref& value);
+
   static inline std::string convert(const Attribute name, const int index);
 
   static std::unordered_map<Attribute, Dict> attribute_dicts_;
@@ -7,36 +7,40 @@
 #define TRANSITIONPARSER_TOOLS_H_
 
 #include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <numeric>
 #include <random>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "transitionparser/corpus.h"
+#include "transitionparser/dataset.h"
+#include "transitionparser/feature.h"
 #include "transitionparser/sentence.h"
+#include "transitionparser/state.h"
 #include "transitionparser/utility.h"
 
 namespace transitionparser {
 
 namespace tools {
 
-std::vector<Sentence> read_conll(const std::string& filepath) {
-  std::ifstream ifs(filepath);
-  if (ifs.fail()) {
-    // @TODO
-  }
-
+// Reads sentences line by line from a stream, e.g. the standard input.
+inline std::vector<Sentence> read_conll(std::istream& is) {
   std::vector<Sentence> sentences;
   std::vector<Token> tokens;
   tokens.push_back(std::move(Token::createRoot()));
   std::string line;
   int count = 0;
 
-  while (getline(ifs, line)) {
+  while (getline(is, line)) {
     utility::string::trim(line);
     if (line.length() == 0) {
       if (tokens.size() > 1) {
-        sentences.emplace_back(++count, tokens);
+        sentences.emplace_back(++count, std::move(tokens));
         tokens.clear();
         tokens.push_back(std::move(Token::createRoot()));
       }
@@ -45,70 +49,311 @@ std::vector<Sentence> read_conll(const std::string& filepath) {
     }
   }
   if (tokens.size() > 1) {
-    sentences.emplace_back(++count, tokens);
+    sentences.emplace_back(++count, std::move(tokens));
   }
   return sentences;
 }
 
+// Splits the tab-separated columns of [begin, end) into `fields` without
+// copying them; the missing columns are left empty.
+inline void split_fields(const char* begin, const char* end,
+                         Token::Fields* fields) {
+  size_t num_fields = 0;
+  const char* field = begin;
+  while (num_fields < fields->size()) {
+    const char* tab = static_cast<const char*>(
+        std::memchr(field, '\t', end - field));
+    if (tab == nullptr) tab = end;
+    (*fields)[num_fields++] = boost::string_ref(field, tab - field);
+    if (tab == end) break;
+    field = tab + 1;
+  }
+  for (; num_fields < fields->size(); ++num_fields) {
+    (*fields)[num_fields].clear();
+  }
+}
+
+// Tokenizes a memory-mapped CoNLL file in place, calling `on_token` with
+// the columns of each non-blank line and `on_break` after each blank line
+// and at the end of the file. Returns false if the file cannot be opened.
+template <typename OnToken, typename OnBreak>
+bool scan_conll(const std::string& filepath, OnToken on_token,
+                OnBreak on_break) {
+  utility::file::MappedFile file(filepath);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  Token::Fields fields;
+  const char* position = file.data();
+  const char* const end = position + file.size();
+  while (position < end) {
+    const char* eol = static_cast<const char*>(
+        std::memchr(position, '\n', end - position));
+    if (eol == nullptr) eol = end;
+    const char* begin = position;
+    const char* last = eol;
+    while (begin < last && std::isspace(static_cast<unsigned char>(*begin))) {
+      ++begin;
+    }
+    while (last > begin
+           && std::isspace(static_cast<unsigned char>(*(last - 1)))) {
+      --last;
+    }
+    position = eol + 1;
+
+    if (begin == last) {
+      on_break();
+      continue;
+    }
+    split_fields(begin, last, &fields);
+    on_token(fields);
+  }
+  on_break();
+  return true;
+}
+
+// Reads sentences from a memory-mapped file. Lines and columns are
+// tokenized in place, so no string is built per line, but each Token still
+// keeps its form, tag and label as strings. read_conll_corpus is the path
+// without allocations per field.
+inline std::vector<Sentence> read_conll(const std::string& filepath) {
+  std::vector<Sentence> sentences;
+  std::vector<Token> tokens;
+  tokens.push_back(Token::createRoot());
+  int count = 0;
+  bool opened = scan_conll(
+      filepath,
+      [&tokens](const Token::Fields& fields) { tokens.emplace_back(fields); },
+      [&]() {
+        if (tokens.size() > 1) {
+          sentences.emplace_back(++count, std::move(tokens));
+          tokens.clear();
+          tokens.push_back(Token::createRoot());
+        }
+      });
+  if (!opened) {
+    TRANSITIONPARSER_EXCEPTION("cannot open '{}'.", filepath);
+  }
+  return sentences;
+}
+
+// Reads the ids of the sentences of a file into columnar storage, without
+// building Token objects.
+inline Corpus read_conll_corpus(const std::string& filepath) {
+  Corpus corpus;
+  bool opened = scan_conll(
+      filepath,
+      [&corpus](const Token::Fields& fields) {
+        corpus.push_back(Token::lookup(fields));
+      },
+      [&corpus]() { corpus.close(); });
+  if (!opened) {
+    TRANSITIONPARSER_EXCEPTION("cannot open '{}'.", filepath);
+  }
+  corpus.shrink_to_fit();
+  return corpus;
+}
+
+// Reads sentences from a stream, e.g. the standard input, a bounded number
+// at a time. The lines of the sentences are kept so that they can be
+// written back by write_conll with the predicted heads and labels. The
+// sentences are numbered from 1 across chunks.
+class ConllChunkReader {
+ public:
+  explicit ConllChunkReader(std::istream& is) : is_(is), count_(0) {}
+
+  // Replaces the contents of `sentences` and `lines` with the next
+  // `max_sentences` sentences at most and their token lines, one after
+  // another. Returns false when the stream has no sentence left.
+  bool read(const size_t max_sentences, std::vector<Sentence>* sentences,
+            std::vector<std::string>* lines) {
+    sentences->clear();
+    lines->clear();
+    while (sentences->size() < max_sentences && next(sentences, lines)) {}
+    return !sentences->empty();
+  }
+
+  // Appends the next sentence and its token lines. Returns false when the
+  // stream has no sentence left.
+  bool next(std::vector<Sentence>* sentences,
+            std::vector<std::string>* lines) {
+    tokens_.clear();
+    tokens_.push_back(Token::createRoot());
+    Token::Fields fields;
+    std::string line;
+    while (getline(is_, line)) {
+      utility::string::trim(line);
+      if (line.length() == 0) {
+        if (tokens_.size() > 1) break;
+        continue;
+      }
+      split_fields(line.data(), line.data() + line.size(), &fields);
+      tokens_.emplace_back(fields);
+      lines->push_back(std::move(line));
+    }
+    if (tokens_.size() == 1) {
+      return false;
+    }
+    sentences->emplace_back(++count_, std::move(tokens_));
+    return true;
+  }
+
+ private:
+  std::istream& is_;
+  int count_;
+  std::vector<Token> tokens_;
+
+  DISALLOW_COPY_AND_MOVE(ConllChunkReader);
+};
+
+// Appends the token lines of a parsed sentence to `out`, with the HEAD and
+// DEPREL columns replaced by the ones of the state, and a blank line.
+// `lines` points to the first token line as read by ConllChunkReader.
+inline void write_conll(const State& state, const std::string* lines,
+                        std::string* out) {
+  const Token::Dict& labels = Token::getDict(Token::DEPREL);
+  Token::Fields fields;
+  for (int i = 1; i < state.numTokens(); ++i) {
+    const std::string& line = lines[i - 1];
+    split_fields(line.data(), line.data() + line.size(), &fields);
+    for (size_t j = 0; j < fields.size(); ++j) {
+      if (j > 0) out->push_back('\t');
+      if (j == Token::HEAD) {
+        out->append(std::to_string(state.head(i)));
+      } else if (j == Token::DEPREL && state.label(i) >= 0) {
+        out->append(labels.lookup(state.label(i)));
+      } else if (fields[j].empty() || j == Token::DEPREL) {
+        out->push_back('_');
+      } else {
+        out->append(fields[j].data(), fields[j].size());
+      }
+    }
+    out->push_back('\n');
+  }
+  out->push_back('\n');
+}
+
+// Returns the ids of the `n` most frequent words in the word slots of the
+// given examples, most frequent first.
+inline std::vector<unsigned> frequent_words(const ExampleSource& examples,
+                                            const size_t n) {
+  std::unordered_map<unsigned, size_t> counts;
+  const size_t chunk_size = 4096;
+  std::vector<size_t> indices;
+  FeatureMatrix features;
+  std::vector<unsigned> actions;
+  for (size_t offset = 0; offset < examples.size(); offset += chunk_size) {
+    const size_t size = std::min(chunk_size, examples.size() - offset);
+    indices.resize(size);
+    std::iota(indices.begin(), indices.end(), offset);
+    examples.gather(indices.data(), size, &features, &actions);
+    for (unsigned j = 0; j < Feature::kNWordFeatures; ++j) {
+      const unsigned* words = features.slot(j);
+      for (size_t i = 0; i < size; ++i) {
+        ++counts[words[i]];
+      }
+    }
+  }
+  std::vector<std::pair<unsigned, size_t>> entries(counts.begin(),
+                                                   counts.end());
+  std::sort(entries.begin(), entries.end(),
+            [](const std::pair<unsigned, size_t>& lhs,
+               const std::pair<unsigned, size_t>& rhs) {
+              return lhs.second > rhs.second
+                  || (lhs.second == rhs.second && lhs.first < rhs.first);
+            });
+  std::vector<unsigned> words;
+  words.reserve(std::min(n, entries.size()));
+  for (size_t i = 0; i < entries.size() && i < n; ++i) {
+    words.push_back(entries[i].first);
+  }
+  return words;
+}
+
+// Splits a permutation of the sample indices [0, size) into batches. A batch
+// is a range of the permutation, so the samples themselves are never copied;
+// they are looked up by index, e.g. with ExampleSource::gather or
+// tools::gather. shuffle() draws a new permutation for the next epoch.
+class BatchIndices {
+ public:
+  struct Batch {
+    const size_t* indices;
+    size_t size;
+  };
+
+  BatchIndices(const size_t size, const size_t batch_size,
+               const bool shuffle = true) :
+      indices_(size), batch_size_(std::max<size_t>(batch_size, 1)),
+      shuffle_(shuffle) {
+    std::iota(indices_.begin(), indices_.end(), 0);
+    this->shuffle();
+  }
+
+  // Permutes the indices in place with the engine carried over from the
+  // previous epoch. Does nothing if shuffling is disabled.
+  void shuffle() {
+    if (shuffle_) std::shuffle(indices_.begin(), indices_.end(), engine_);
+  }
+
+  size_t size() const {
+    return (indices_.size() + batch_size_ - 1) / batch_size_;
+  }
+
+  Batch operator[](const size_t batch_index) const {
+    const size_t offset = batch_index * batch_size_;
+    return {indices_.data() + offset,
+            std::min(indices_.size() - offset, batch_size_)};
+  }
+
+  size_t numSamples() const {
+    return indices_.size();
+  }
+
+ private:
+  std::vector<size_t> indices_;
+  const size_t batch_size_;
+  const bool shuffle_;
+  std::mt19937 engine_;
+};
+
+// Copies the samples of a batch into `out`, reusing its capacity.
+template<typename T>
+void gather(const std::vector<T>& samples, const BatchIndices::Batch& batch,
+            std::vector<T>* out) {
+  out->resize(batch.size);
+  for (size_t i = 0; i < batch.size; ++i) {
+    (*out)[i] = samples[batch.indices[i]];
+  }
+}
+
 template<typename T>
 std::vector<std::vector<T>> create_batch(const std::vector<T>& samples,
                                          const size_t batch_size,
                                          const bool shuffle = true) {
-  size_t sample_size = samples.size();
-  size_t num_batches = sample_size / batch_size + 1;
-
-  std::vector<int> indices(sample_size);
-  std::iota(std::begin(indices), std::end(indices), 0);
-  if (shuffle) std::shuffle(indices.begin(), indices.end(), std::mt19937());
-
-  std::vector<std::vector<T>> batches;
-  batches.reserve(num_batches);
-
-  for (int batch_index = 0; batch_index < num_batches; ++batch_index) {
-    int offset = batch_index * batch_size;
-    const size_t current_batch_size =
-        std::min(sample_size - offset, batch_size);
-    std::vector<T> batch(current_batch_size);
-    for (int index = 0; index < current_batch_size; ++index) {
-      batch[index] = samples[indices[offset + index]];
-    }
-    batches.push_back(std::move(batch));
+  BatchIndices indices(samples.size(), batch_size, shuffle);
+  std::vector<std::vector<T>> batches(indices.size());
+  for (size_t batch_index = 0; batch_index < indices.size(); ++batch_index) {
+    gather(samples, indices[batch_index], &batches[batch_index]);
   }
-
   return batches;
 }
 
 template<typename X, typename Y>
 std::vector<std::pair<std::vector<X>, std::vector<Y>>>
-create_batch(std::vector<X> samples_x,
-             std::vector<Y> samples_y,
+create_batch(const std::vector<X>& samples_x,
+             const std::vector<Y>& samples_y,
              const size_t batch_size,
              const bool shuffle = true) {
-  size_t sample_size = samples_x.size();
-  TRANSITIONPARSER_ASSERT(sample_size = samples_y.size(),
+  TRANSITIONPARSER_ASSERT(samples_x.size() == samples_y.size(),
                      "samples_x and samples_y must be same size");
-  size_t num_batches = sample_size / batch_size + 1;
-
-  std::vector<int> indices(sample_size);
-  std::iota(std::begin(indices), std::end(indices), 0);
-  if (shuffle) std::shuffle(indices.begin(), indices.end(), std::mt19937());
-
-  std::vector<std::pair<std::vector<X>, std::vector<Y>>> batches;
-  batches.reserve(num_batches);
-
-  for (unsigned batch_index = 0; batch_index < num_batches; ++batch_index) {
-    int offset = batch_index * batch_size;
-    const size_t current_batch_size =
-        std::min(sample_size - offset, batch_size);
-    std::vector<X> batch_x(current_batch_size);
-    std::vector<Y> batch_y(current_batch_size);
-    for (unsigned index = 0; index < current_batch_size; ++index) {
-      batch_x[index] = samples_x[indices[offset + index]];
-      batch_y[index] = samples_y[indices[offset + index]];
-    }
-    batches.emplace_back(std::move(batch_x), std::move(batch_y));
+  BatchIndices indices(samples_x.size(), batch_size, shuffle);
+  std::vector<std::pair<std::vector<X>, std::vector<Y>>> batches(
+      indices.size());
+  for (size_t batch_index = 0; batch_index < indices.size(); ++batch_index) {
+    gather(samples_x, indices[batch_index], &batches[batch_index].first);
+    gather(samples_y, indices[batch_index], &batches[batch_index].second);
   }
-
   return batches;
 }
 
@@ -5,11 +5,31 @@
 
 #include "transitionparser/transition.h"
 
+#include <algorithm>
+#include <cmath>
 #include <utility>
 #include <vector>
 
 namespace transitionparser {
 
+namespace {
+
+// Returns the first of the actions `begin`, `begin + stride`, ... below
+// `end` with the highest score. The maximum is found first in a loop the
+// compiler can vectorize, and only then its position.
+inline Action argmax(const float* scores, int begin, int end, int stride) {
+  float best_score = -INFINITY;
+  for (int action = begin; action < end; action += stride) {
+    best_score = std::max(best_score, scores[action]);
+  }
+  for (int action = begin; action < end; action += stride) {
+    if (scores[action] == best_score) return action;
+  }
+  return NoneAction;
+}
+
+}  // namespace
+
 int Transition::numActionTypes() {
   return 3;
 }
@@ -45,6 +65,22 @@ int Transition::label(Action action) {
 }
 
 void Transition::apply(Action action, State* state) {
+  perform(action, state);
+  state->record(action);
+}
+
+// Returns a new state that results from applying the action to a copy of the
+// given state, leaving the original untouched.
+std::unique_ptr<State> Transition::successor(Action action,
+                                             const State& state) {
+  auto next = std::make_unique<State>(state, action, state.stack(),
+                                      state.buffer(), state.heads(),
+                                      state.labels());
+  perform(action, next.get());
+  return next;
+}
+
+void Transition::perform(Action action, State* state) {
   switch (actionType(action)) {
     case SHIFT:
       shift(state);
@@ -59,7 +95,6 @@ void Transition::apply(Action action, State* state) {
       TRANSITIONPARSER_EXCEPTION("INVALID ACTION {}", action);
       break;
   }
-  state->record(action);
 }
 
 // Shift: (s, i|b, A) => (s|i, b, A)
@@ -107,6 +142,42 @@ bool Transition::isAllowedRight(const State& state) {
   return state.stackSize() > 1;
 }
 
+Transition::ActionMask Transition::allowedActionTypes(const State& state) {
+  ActionMask mask = 0;
+  if (isAllowedShift(state)) mask |= 1 << SHIFT;
+  if (isAllowedLeft(state)) mask |= 1 << LEFT;
+  if (isAllowedRight(state)) mask |= 1 << RIGHT;
+  return mask;
+}
+
+bool Transition::isAllowed(Action action, ActionMask mask) {
+  return (mask >> actionType(action)) & 1;
+}
+
+// SHIFT is the only action without a label, so it is the only one that can
+// be forced; it is, whenever the stack holds less than two tokens.
+Action Transition::forcedAction(const State& state) {
+  return allowedActionTypes(state) == 1 << SHIFT ? shiftAction() : NoneAction;
+}
+
+// The LEFT and RIGHT actions interleave, so the scores of either type are
+// every other one and the scores of both are contiguous.
+Action Transition::bestAllowed(const float* scores, int num_actions,
+                               ActionMask mask) {
+  Action best_action = NoneAction;
+  if (mask & (1 << LEFT)) {
+    best_action = argmax(scores, LEFT, num_actions,
+                         mask & (1 << RIGHT) ? 1 : 2);
+  } else if (mask & (1 << RIGHT)) {
+    best_action = argmax(scores, RIGHT, num_actions, 2);
+  }
+  if ((mask & (1 << SHIFT)) &&
+      (best_action == NoneAction || scores[SHIFT] >= scores[best_action])) {
+    return shiftAction();
+  }
+  return best_action;
+}
+
 bool Transition::isTerminal(const State& state) {
   return state.end() && state.stackSize() < 2;
 }
@@ -116,25 +187,25 @@ Action Transition::getOracle(const State& state) {
     // assert !state.isTerminal()
     return shiftAction();
   }
-  const Token& s0 = state.getToken(state.stack(0));
-  const Token& s1 = state.getToken(state.stack(1));
-  if (s0.head == s1.id && doneRightChildrenOf(state, s0.id)) {
-    return rightAction(s0.label);
+  const SentenceView& sentence = state.sentence();
+  const int s0 = state.stack(0);
+  const int s1 = state.stack(1);
+  if (sentence.heads[s0] == s1 && doneRightChildrenOf(state, s0)) {
+    return rightAction(sentence.labels[s0]);
   }
-  if (s1.head == s0.id) {
-    return leftAction(s1.label);
+  if (sentence.heads[s1] == s0) {
+    return leftAction(sentence.labels[s1]);
   }
   return shiftAction();
 }
 
+// Called with s0 = head right above its gold head s1. In a projective tree
+// every left child of s0 lies between s1 and s0 and has therefore been
+// attached already, so comparing the number of attached children with the
+// gold count tells whether a right child is still in the buffer.
 bool Transition::doneRightChildrenOf(const State& state, int head) {
-  int index = state.buffer();
-  while (index < state.numTokens()) {
-    int actual_head = state.getToken(index).head;
-    if (actual_head == head) return false;
-    index = head > index ? head : index + 1;
-  }
-  return true;
+  return state.numChildren(head)
+      == static_cast<int>(state.sentence().children[head]);
 }
 
 }  // namespace transitionparser
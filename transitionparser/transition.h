@@ -26,6 +26,9 @@ class Transition {
       RIGHT  = 2,
   };
 
+  // A set of action types, with the bit `1 << type` for each of them.
+  typedef unsigned ActionMask;
+
   static int numActionTypes();
 
   static int numActions(int num_labels);
@@ -42,6 +45,8 @@ class Transition {
 
   static void apply(Action action, State* state);
 
+  static std::unique_ptr<State> successor(Action action, const State& state);
+
   static void shift(State* state);
 
   static void left(State* state, int label);
@@ -56,6 +61,19 @@ class Transition {
 
   static bool isAllowedRight(const State& state);
 
+  static ActionMask allowedActionTypes(const State& state);
+
+  static bool isAllowed(Action action, ActionMask mask);
+
+  // Returns the only action allowed in the state when there is nothing to
+  // score, otherwise NoneAction.
+  static Action forcedAction(const State& state);
+
+  // Returns the allowed action with the highest of the `num_actions` scores,
+  // the lowest one on ties.
+  static Action bestAllowed(const float* scores, int num_actions,
+                            ActionMask mask);
+
   static bool isTerminal(const State& state);
 
   static Action getOracle(const State& state);
@@ -63,6 +81,8 @@ class Transition {
   static bool doneRightChildrenOf(const State& state, int head);
 
  private:
+  static void perform(Action action, State* state);
+
   Transition() = delete;
   DISALLOW_COPY_AND_MOVE(Transition);
   ~Transition() = delete;
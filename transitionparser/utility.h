@@ -6,6 +6,8 @@
 #ifndef TRANSITIONPARSER_UTILITY_H_
 #define TRANSITIONPARSER_UTILITY_H_
 
+#include <ostream>
+#include <vector>
 
 #ifndef USE_INTERNAL_FMT
 template <class T>
@@ -17,15 +19,27 @@ std::ostream& operator<<(std::ostream&, const std::vector<T>&);
 #endif
 #include <boost/uuid/random_generator.hpp>
 #include <boost/uuid/uuid_io.hpp>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <ctime>
 #include <chrono>  // NOLINT(build/c++11)
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <exception>
 #include <fstream>
 #include <functional>
+#include <iostream>
+#include <mutex>  // NOLINT(build/c++11)
 #include <regex>  // NOLINT(build/c++11)
 #include <sstream>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -233,8 +247,275 @@ static inline void write(const char* path, const char* data) {
   outFile << data << std::endl;
 }
 
+// Read-only memory mapping of a whole file.
+class MappedFile {
+ public:
+  MappedFile() {}
+
+  explicit MappedFile(const std::string& path) {
+    open(path);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    close();
+  }
+
+  bool open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        ::close(fd);
+        size_ = 0;
+        return false;
+      }
+      data_ = static_cast<const char*>(addr);
+      madvise(addr, size_, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    open_ = true;
+    return true;
+  }
+
+  void close() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+  }
+
+  bool is_open() const {
+    return open_;
+  }
+
+  const char* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool open_ = false;
+};
+
 }  // namespace file
 
+namespace process {
+
+namespace internal {
+
+// Kills and reaps the forked workers and closes their pipes.
+inline void kill_workers(std::vector<pid_t>* pids, std::vector<int>* fds) {
+  for (size_t k = 0; k < pids->size(); ++k) {
+    ::close((*fds)[k]);
+    ::kill((*pids)[k], SIGKILL);
+    waitpid((*pids)[k], nullptr, 0);
+  }
+  pids->clear();
+  fds->clear();
+}
+
+// Forks a child running `f(k)` for each k in [first, n), which writes its
+// result to a pipe and exits without running destructors. If a pipe or a
+// child cannot be created, the children already forked are killed before
+// throwing.
+template <typename T, typename F>
+void fork_workers(const unsigned first, const unsigned n, F& f,
+                  std::vector<pid_t>* pids, std::vector<int>* fds) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "the result is sent back as raw bytes");
+  for (unsigned k = first; k < n; ++k) {
+    int fd[2];
+    if (pipe(fd) != 0) {
+      kill_workers(pids, fds);
+      TRANSITIONPARSER_EXCEPTION("cannot create a pipe for worker {}.", k);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      ::close(fd[0]);
+      ::close(fd[1]);
+      kill_workers(pids, fds);
+      TRANSITIONPARSER_EXCEPTION("cannot fork worker {}.", k);
+    }
+    if (pid == 0) {
+      ::close(fd[0]);
+      int status = 0;
+      try {
+        const T result = f(k);
+        const char* data = reinterpret_cast<const char*>(&result);
+        for (size_t written = 0; written < sizeof(T);) {
+          ssize_t count = ::write(fd[1], data + written, sizeof(T) - written);
+          if (count <= 0) {
+            status = 1;
+            break;
+          }
+          written += count;
+        }
+      } catch (const std::exception& e) {
+        std::cerr << "worker " << k << ": " << e.what() << std::endl;
+        status = 1;
+      }
+      _exit(status);
+    }
+    ::close(fd[1]);
+    pids->push_back(pid);
+    fds->push_back(fd[0]);
+  }
+}
+
+// Reads the results of the forked workers and reaps them. Returns false if
+// any of them failed.
+template <typename T>
+bool join_workers(const std::vector<pid_t>& pids, const std::vector<int>& fds,
+                  T* results) {
+  bool succeeded = true;
+  for (size_t k = 0; k < pids.size(); ++k) {
+    char* data = reinterpret_cast<char*>(&results[k]);
+    size_t read = 0;
+    while (read < sizeof(T)) {
+      ssize_t count = ::read(fds[k], data + read, sizeof(T) - read);
+      if (count <= 0) break;
+      read += count;
+    }
+    ::close(fds[k]);
+    int status;
+    waitpid(pids[k], &status, 0);
+    succeeded &= read == sizeof(T) && WIFEXITED(status)
+        && WEXITSTATUS(status) == 0;
+  }
+  return succeeded;
+}
+
+}  // namespace internal
+
+// Runs `f(k)` for k in [0, n) in n forked child processes and returns their
+// results in order of k. Each child writes its result back through a pipe
+// and exits without running destructors, so anything the children share
+// with the parent must live in memory mapped as shared before the call.
+template <typename T, typename F>
+std::vector<T> fork_join(const unsigned n, F f) {
+  std::vector<pid_t> pids;
+  std::vector<int> fds;
+  internal::fork_workers<T>(0, n, f, &pids, &fds);
+  std::vector<T> results(n);
+  if (!internal::join_workers<T>(pids, fds, results.data())) {
+    TRANSITIONPARSER_EXCEPTION("a worker process failed.");
+  }
+  return results;
+}
+
+// Same as fork_join, except that `f(0)` runs in the calling process while
+// the children run the others, so its side effects persist after the call.
+// The children are reaped even if `f(0)` throws; it is up to `f` to make
+// sure that they do not wait for the calling process in that case.
+template <typename T, typename F>
+std::vector<T> fork_join_here(const unsigned n, F f) {
+  TRANSITIONPARSER_ASSERT(n > 0, "no worker to run");
+  std::vector<pid_t> pids;
+  std::vector<int> fds;
+  internal::fork_workers<T>(1, n, f, &pids, &fds);
+  std::vector<T> results(n);
+  try {
+    results[0] = f(0);
+  } catch (...) {
+    internal::join_workers<T>(pids, fds, results.data() + 1);
+    throw;
+  }
+  if (!internal::join_workers<T>(pids, fds, results.data() + 1)) {
+    TRANSITIONPARSER_EXCEPTION("a worker process failed.");
+  }
+  return results;
+}
+
+}  // namespace process
+
+namespace thread {
+
+// Runs one task at a time on a thread of its own, e.g. to overlap two
+// stages of a loop. An exception thrown by a task is rethrown by wait().
+class Worker {
+ public:
+  Worker() : thread_(&Worker::loop, this) {}
+
+  Worker(const Worker&) = delete;
+  Worker& operator=(const Worker&) = delete;
+
+  ~Worker() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopped_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+  }
+
+  // Starts the task; the previous one must have been waited for.
+  void run(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = std::move(task);
+    }
+    changed_.notify_all();
+  }
+
+  // Blocks until the task has finished, and rethrows what it threw.
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this]() { return !task_; });
+    if (error_) {
+      std::exception_ptr error = nullptr;
+      std::swap(error, error_);
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  void loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      changed_.wait(lock, [this]() { return task_ || stopped_; });
+      if (!task_) return;
+      lock.unlock();
+      std::exception_ptr error = nullptr;
+      try {
+        task_();
+      } catch (...) {
+        error = std::current_exception();
+      }
+      lock.lock();
+      task_ = nullptr;
+      error_ = error;
+      changed_.notify_all();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::function<void()> task_;
+  std::exception_ptr error_;
+  bool stopped_ = false;
+  std::thread thread_;
+};
+
+}  // namespace thread
+
 namespace hash {
 
 static inline std::string generate_uuid() {